@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #include <pulsecore/pulsecore-config.h>
 
@@ -64,6 +66,8 @@ static int card_is_typeof(struct pa_classify_card_def *, char *,
 
 char *get_property(char *, pa_proplist *, char *);
 
+static int parse_number(const char *, const char **, long *);
+
 
 
 struct pa_classify *pa_classify_new(struct userdata *u)
@@ -563,10 +567,7 @@ static void streams_free(struct pa_classify_stream_def *defs)
     for (stream = defs;  stream;  stream = next) {
         next = stream->next;
 
-        if (stream->method == pa_classify_method_matches)
-            regfree(&stream->arg.rexp);
-        else
-            pa_xfree((void *)stream->arg.string);
+        pa_classify_arg_cleanup(stream->method, &stream->arg);
 
         pa_xfree(stream->prop);
         pa_xfree(stream->exe);
@@ -641,6 +642,21 @@ static void streams_add(struct pa_classify_stream_def **defs, char *prop,
                 memset(&d->arg, 0, sizeof(d->arg));
                 break;
 
+            case pa_method_lt:
+            case pa_method_le:
+            case pa_method_gt:
+            case pa_method_ge:
+            case pa_method_range:
+                snprintf(method_def, sizeof(method_def), "%s %s:%s", prop,
+                         pa_classify_method_str(method), arg);
+                if (!pa_classify_numeric_setup(method, arg, &d->method,
+                                               &d->arg)) {
+                    pa_log("%s: invalid numeric definition '%s'",
+                           __FUNCTION__, arg);
+                    pa_assert_se(0);
+                }
+                break;
+
             default:
                 /* never supposed to get here. just keep the compiler happy */
                 pa_assert_se(0);
@@ -750,10 +766,7 @@ static void devices_free(struct pa_classify_device *sinks)
         for (d = sinks->defs;  d->type;  d++) {
             pa_xfree((void *)d->type);
 
-            if (d->method == pa_classify_method_matches)
-                regfree(&d->arg.rexp);
-            else
-                pa_xfree((void *)d->arg.string);
+            pa_classify_arg_cleanup(d->method, &d->arg);
         }
 
         pa_xfree(sinks);
@@ -801,13 +814,23 @@ static void devices_add(struct pa_classify_device **p_devices, char *type,
 
     case pa_method_matches:
         method_name = "matches";
-        if (regcomp(&d->arg.rexp, arg, 0) == 0) {
-            d->method = pa_classify_method_matches;
-            break;
-        }
-        /* intentional fall trough */
+        if (regcomp(&d->arg.rexp, arg, 0) != 0)
+            goto invalid;
+        d->method = pa_classify_method_matches;
+        break;
+
+    case pa_method_lt:
+    case pa_method_le:
+    case pa_method_gt:
+    case pa_method_ge:
+    case pa_method_range:
+        method_name = (char *)pa_classify_method_str(method);
+        if (!pa_classify_numeric_setup(method, arg, &d->method, &d->arg))
+            goto invalid;
+        break;
 
     default:
+    invalid:
         pa_log("%s: invalid device definition %s", __FUNCTION__, type);
         memset(d, 0, sizeof(*d));
         return;
@@ -891,10 +914,7 @@ static void cards_free(struct pa_classify_card *cards)
             pa_xfree((void *)d->type);
             pa_xfree((void *)d->data.profile);
 
-            if (d->method == pa_classify_method_matches)
-                regfree(&d->arg.rexp);
-            else
-                pa_xfree((void *)d->arg.string);
+            pa_classify_arg_cleanup(d->method, &d->arg);
         }
 
         pa_xfree(cards);
@@ -942,13 +962,23 @@ static void cards_add(struct pa_classify_card **p_cards, char *type,
 
     case pa_method_matches:
         method_name = "matches";
-        if (regcomp(&d->arg.rexp, arg, 0) == 0) {
-            d->method = pa_classify_method_matches;
-            break;
-        }
-        /* intentional fall trough */
+        if (regcomp(&d->arg.rexp, arg, 0) != 0)
+            goto invalid;
+        d->method = pa_classify_method_matches;
+        break;
+
+    case pa_method_lt:
+    case pa_method_le:
+    case pa_method_gt:
+    case pa_method_ge:
+    case pa_method_range:
+        method_name = (char *)pa_classify_method_str(method);
+        if (!pa_classify_numeric_setup(method, arg, &d->method, &d->arg))
+            goto invalid;
+        break;
 
     default:
+    invalid:
         pa_log("%s: invalid card definition %s", __FUNCTION__, type);
         memset(d, 0, sizeof(*d));
         return;
@@ -1105,6 +1135,150 @@ int pa_classify_method_true(const char *string,
 
     return TRUE;
 }
+
+int pa_classify_method_lt(const char *string, union pa_classify_arg *arg)
+{
+    long value;
+
+    return arg && parse_number(string, NULL, &value) && value < arg->number;
+}
+
+int pa_classify_method_le(const char *string, union pa_classify_arg *arg)
+{
+    long value;
+
+    return arg && parse_number(string, NULL, &value) && value <= arg->number;
+}
+
+int pa_classify_method_gt(const char *string, union pa_classify_arg *arg)
+{
+    long value;
+
+    return arg && parse_number(string, NULL, &value) && value > arg->number;
+}
+
+int pa_classify_method_ge(const char *string, union pa_classify_arg *arg)
+{
+    long value;
+
+    return arg && parse_number(string, NULL, &value) && value >= arg->number;
+}
+
+int pa_classify_method_range(const char *string, union pa_classify_arg *arg)
+{
+    long value;
+
+    if (!arg || !parse_number(string, NULL, &value))
+        return FALSE;
+
+    return value >= arg->range.min && value <= arg->range.max;
+}
+
+int pa_classify_method_is_numeric(enum pa_classify_method method)
+{
+    return method >= pa_method_lt && method <= pa_method_range;
+}
+
+const char *pa_classify_method_str(enum pa_classify_method method)
+{
+    switch (method) {
+    case pa_method_equals:      return "equals";
+    case pa_method_startswith:  return "startswith";
+    case pa_method_matches:     return "matches";
+    case pa_method_true:        return "true";
+    case pa_method_lt:          return "lt";
+    case pa_method_le:          return "le";
+    case pa_method_gt:          return "gt";
+    case pa_method_ge:          return "ge";
+    case pa_method_range:       return "range";
+    default:                    return "<unknown>";
+    }
+}
+
+/*
+ * The argument of the numeric methods is converted here, ie. once when the
+ * configuration is loaded; the range is given as 'min..max'.
+ */
+int pa_classify_numeric_setup(enum pa_classify_method method, const char *arg,
+                              int (**method_ret)(const char *,
+                                                 union pa_classify_arg *),
+                              union pa_classify_arg *arg_ret)
+{
+    int (*fn)(const char *, union pa_classify_arg *);
+    const char *e;
+    long        min;
+    long        max;
+
+    pa_assert(method_ret);
+    pa_assert(arg_ret);
+
+    memset(arg_ret, 0, sizeof(*arg_ret));
+    *method_ret = NULL;
+
+    switch (method) {
+    case pa_method_lt:      fn = pa_classify_method_lt;      break;
+    case pa_method_le:      fn = pa_classify_method_le;      break;
+    case pa_method_gt:      fn = pa_classify_method_gt;      break;
+    case pa_method_ge:      fn = pa_classify_method_ge;      break;
+    case pa_method_range:   fn = pa_classify_method_range;   break;
+    default:                return FALSE;
+    }
+
+    if (method != pa_method_range) {
+        if (!parse_number(arg, NULL, &arg_ret->number))
+            return FALSE;
+    }
+    else {
+        if (!parse_number(arg, &e, &min) || strncmp(e, "..", 2) ||
+            !parse_number(e + 2, NULL, &max) || min > max)
+            return FALSE;
+
+        arg_ret->range.min = min;
+        arg_ret->range.max = max;
+    }
+
+    *method_ret = fn;
+
+    return TRUE;
+}
+
+void pa_classify_arg_cleanup(int (*method)(const char *,
+                                           union pa_classify_arg *),
+                             union pa_classify_arg *arg)
+{
+    if (method == pa_classify_method_matches)
+        regfree(&arg->rexp);
+    else if (method == pa_classify_method_equals ||
+             method == pa_classify_method_startswith)
+        pa_xfree((void *)arg->string);
+
+    memset(arg, 0, sizeof(*arg));
+}
+
+/*
+ * Parse a decimal integer. Without 'end' the whole string must be consumed,
+ * otherwise the position of the first unparsed character is returned there.
+ */
+static int parse_number(const char *string, const char **end, long *value)
+{
+    char *e;
+
+    if (string == NULL || !string[0])
+        return FALSE;
+
+    errno  = 0;
+    *value = strtol(string, &e, 10);
+
+    if (errno != 0 || e == string)
+        return FALSE;
+
+    if (end != NULL)
+        *end = e;
+    else if (*e != '\0')
+        return FALSE;
+
+    return TRUE;
+}
                                   
 /*
  * Local Variables:
@@ -26,12 +26,24 @@ enum pa_classify_method {
     pa_method_startswith,
     pa_method_matches,
     pa_method_true,
+    pa_method_lt,              /* numerically less than */
+    pa_method_le,              /* numerically less than or equal */
+    pa_method_gt,              /* numerically greater than */
+    pa_method_ge,              /* numerically greater than or equal */
+    pa_method_range,           /* numerically within [min..max] */
     pa_method_max
 };
 
+struct pa_classify_range {
+    long        min;
+    long        max;
+};
+
 union pa_classify_arg {
-    const char *string;
-    regex_t     rexp;
+    const char               *string;
+    regex_t                   rexp;
+    long                      number;   /* for lt, le, gt and ge */
+    struct pa_classify_range  range;    /* for range */
 };
 
 struct pa_classify_pid_hash {
@@ -142,6 +154,19 @@ int   pa_classify_method_equals(const char *, union pa_classify_arg *);
 int   pa_classify_method_startswith(const char *, union pa_classify_arg *);
 int   pa_classify_method_matches(const char *, union pa_classify_arg *);
 int   pa_classify_method_true(const char *, union pa_classify_arg *);
+int   pa_classify_method_lt(const char *, union pa_classify_arg *);
+int   pa_classify_method_le(const char *, union pa_classify_arg *);
+int   pa_classify_method_gt(const char *, union pa_classify_arg *);
+int   pa_classify_method_ge(const char *, union pa_classify_arg *);
+int   pa_classify_method_range(const char *, union pa_classify_arg *);
+
+int   pa_classify_method_is_numeric(enum pa_classify_method);
+const char *pa_classify_method_str(enum pa_classify_method);
+int   pa_classify_numeric_setup(enum pa_classify_method, const char *,
+                                int (**)(const char *,union pa_classify_arg *),
+                                union pa_classify_arg *);
+void  pa_classify_arg_cleanup(int (*)(const char *, union pa_classify_arg *),
+                              union pa_classify_arg *);
 
 #endif
 
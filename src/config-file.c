@@ -81,6 +81,10 @@ struct groupdef {
     char                    *sink;
     char                    *source;
     uint32_t                 flags;
+    uint32_t                 latency;   /* requested latency in msec */
+    pa_resample_method_t     resample;  /* resampler of the streams */
+    uint32_t                 maxsinp;   /* max. number of sink inputs */
+    enum pa_policy_group_overflow overflow;
 };
 
 struct devicedef {
@@ -151,6 +155,7 @@ static int contextsetprop_parse(int, char *, struct contextdef *);
 static int contextdelprop_parse(int, char *, struct contextdef *);
 static int contextanyprop_parse(int, char *, char *, struct anyprop *);
 static int cardname_parse(int, char *, struct carddef *);
+static enum pa_classify_method method_parse(int, char *, char *);
 static int flags_parse(int lineno, char *, uint32_t *);
 static int valid_label(int, char *);
 
@@ -343,6 +348,7 @@ static int section_open(struct userdata *u, enum section_type type,
             
         case section_group:
             sec->def.group = pa_xnew0(struct groupdef, 1);
+            sec->def.group->resample = PA_RESAMPLER_INVALID;
             status = 0;
             break;
             
@@ -384,6 +390,7 @@ static int section_open(struct userdata *u, enum section_type type,
 static int section_close(struct userdata *u, struct section *sec)
 {
     struct groupdef   *grdef;
+    struct pa_policy_group *group;
     struct devicedef  *devdef;
     struct carddef    *carddef;
     struct streamdef  *strdef;
@@ -404,8 +411,19 @@ static int section_close(struct userdata *u, struct section *sec)
             status = 0;
             grdef  = sec->def.group;
 
-            pa_policy_group_new(u, grdef->name, grdef->sink,
-                                grdef->source, grdef->flags);
+            group  = pa_policy_group_new(u, grdef->name, grdef->sink,
+                                         grdef->source, grdef->flags);
+
+            if (group != NULL) {
+                group->latency  = grdef->latency * PA_USEC_PER_MSEC;
+                group->resample = grdef->resample;
+                group->maxsinp  = grdef->maxsinp;
+                group->overflow = grdef->overflow;
+
+                if (group->maxsinp > 0 &&
+                    group->overflow == pa_policy_overflow_unknown)
+                    group->overflow = pa_policy_overflow_reject;
+            }
 
             pa_xfree(grdef->name);
             pa_xfree(grdef->sink);
@@ -493,7 +511,7 @@ static int section_close(struct userdata *u, struct section *sec)
 
                     if (rule != NULL) {
                         pa_policy_context_add_property_action(
-                                          rule, act->lineno,
+                                          u, rule, act->lineno,
                                           setprop->objtype,
                                           setprop->method,
                                           setprop->arg,
@@ -514,7 +532,7 @@ static int section_close(struct userdata *u, struct section *sec)
 
                     if (rule != NULL) {
                         pa_policy_context_delete_property_action(
-                                          rule, act->lineno,
+                                          u, rule, act->lineno,
                                           delprop->objtype,
                                           delprop->method,
                                           delprop->arg,
@@ -577,6 +595,41 @@ static int groupdef_parse(int lineno, char *line, struct groupdef *grdef)
         else if (!strncmp(line, "source=", 7)) {
             grdef->source = pa_xstrdup(line+7);
         }
+        else if (!strncmp(line, "resample_method=", 16)) {
+            grdef->resample = pa_parse_resample_method(line+16);
+
+            if (grdef->resample == PA_RESAMPLER_INVALID) {
+                pa_log("invalid resample method '%s' in line %d",
+                       line+16, lineno);
+                sts = -1;
+            }
+        }
+        else if (!strncmp(line, "max_streams=", 12)) {
+            grdef->maxsinp = strtoul(line+12, &end, 10);
+
+            if (line[12] == '\0' || *end != '\0') {
+                pa_log("invalid max_streams '%s' in line %d", line+12, lineno);
+                sts = -1;
+            }
+        }
+        else if (!strncmp(line, "overflow=", 9)) {
+            if (!strcmp(line+9, "reject"))
+                grdef->overflow = pa_policy_overflow_reject;
+            else if (!strcmp(line+9, "cork_oldest"))
+                grdef->overflow = pa_policy_overflow_cork;
+            else {
+                pa_log("invalid overflow '%s' in line %d", line+9, lineno);
+                sts = -1;
+            }
+        }
+        else if (!strncmp(line, "latency=", 8)) {
+            grdef->latency = strtoul(line+8, &end, 10);
+
+            if (line[8] == '\0' || *end != '\0') {
+                pa_log("invalid latency '%s' in line %d", line+8, lineno);
+                sts = -1;
+            }
+        }
         else if (!strncmp(line, "flags=", 6)) { 
             fldef = line + 6;
             
@@ -614,6 +667,12 @@ static int groupdef_parse(int lineno, char *line, struct groupdef *grdef)
                             flags |= PA_POLICY_GROUP_FLAG_CORK_STREAM;
                         else if (!strcmp(flname, "mute_by_route"))
                             flags |= PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE;
+                        else if (!strcmp(flname, "lazy_move"))
+                            flags |= PA_POLICY_GROUP_FLAG_LAZY_MOVE;
+                        else if (!strcmp(flname, "group_bus"))
+                            flags |= PA_POLICY_GROUP_FLAG_GROUP_BUS;
+                        else if (!strcmp(flname, "mute_in_place"))
+                            flags |= PA_POLICY_GROUP_FLAG_MUTE_IN_PLACE;
                         else {
                             pa_log("invalid flag '%s' in line %d",
                                    flname, lineno);
@@ -849,16 +908,9 @@ static int deviceprop_parse(int lineno, enum device_class class,
         method = at + 1;
     }
     
-    if (!strcmp(method, "equals"))
-        devdef->method = pa_method_equals;
-    else if (!strcmp(method, "startswith"))
-        devdef->method = pa_method_startswith;
-    else if (!strcmp(method, "matches"))
-        devdef->method = pa_method_matches;
-    else {
-        pa_log("invalid method '%s' in line %d", method, lineno);
+    devdef->method = method_parse(lineno, method, arg);
+    if (devdef->method == pa_method_unknown)
         return -1;
-    }
     
     devdef->class = class;
     devdef->prop  = pa_xstrdup(prop);
@@ -892,16 +944,9 @@ static int streamprop_parse(int lineno,char *propdef,struct streamdef *strdef)
     prop   = propdef;
     method = at + 1;
     
-    if (!strcmp(method, "equals"))
-        strdef->method = pa_method_equals;
-    else if (!strcmp(method, "startswith"))
-        strdef->method = pa_method_startswith;
-    else if (!strcmp(method, "matches"))
-        strdef->method = pa_method_matches;
-    else {
-        pa_log("invalid method '%s' in line %d", method, lineno);
+    strdef->method = method_parse(lineno, method, arg);
+    if (strdef->method == pa_method_unknown)
         return -1;
-    }
     
     strdef->prop  = pa_xstrdup(prop);
     strdef->arg   = pa_xstrdup(arg);
@@ -924,16 +969,12 @@ static int contextval_parse(int lineno,char *valdef, struct contextdef *ctxdef)
     method = valdef;
     arg    = colon + 1;
     
-    if (!strcmp(method, "equals"))
-        ctxdef->method = pa_method_equals;
-    else if (!strcmp(method, "startswith"))
-        ctxdef->method = pa_method_startswith;
-    else if (!strcmp(method, "matches"))
-        ctxdef->method = strcmp(arg, "*") ? pa_method_matches : pa_method_true;
-    else {
-        pa_log("invalid method '%s' in line %d", method, lineno);
+    ctxdef->method = method_parse(lineno, method, arg);
+    if (ctxdef->method == pa_method_unknown)
         return -1;
-    }
+
+    if (ctxdef->method == pa_method_matches && !strcmp(arg, "*"))
+        ctxdef->method = pa_method_true;
     
     ctxdef->arg = (ctxdef->method == pa_method_true) ? NULL : pa_xstrdup(arg);
     
@@ -1095,17 +1136,9 @@ static int contextanyprop_parse(int lineno, char *objdef, char *propdef,
     *colon = '\0';
     arg = colon + 1;
 
-
-    if (!strcmp(method, "equals"))
-        anyprop->method = pa_method_equals;
-    else if (!strcmp(method, "startswith"))
-        anyprop->method = pa_method_startswith;
-    else if (!strcmp(method, "matches"))
-        anyprop->method = pa_method_matches;
-    else {
-        pa_log("invalid method '%s' in line %d", method, lineno);
+    anyprop->method = method_parse(lineno, method, arg);
+    if (anyprop->method == pa_method_unknown)
         return -1;
-    }
     
     if (!strncmp(propdef, "property:", 9))
         propnam = propdef + 9;
@@ -1135,20 +1168,52 @@ static int cardname_parse(int lineno, char *namedef, struct carddef *carddef)
     method = namedef;
     arg    = colon + 1;
 
+    carddef->method = method_parse(lineno, method, arg);
+    if (carddef->method == pa_method_unknown)
+        return -1;
+    
+    carddef->arg   = pa_xstrdup(arg);
+    
+    return 0;
+}
+
+static enum pa_classify_method method_parse(int lineno, char *method,
+                                           char *arg)
+{
+    enum pa_classify_method  m;
+    int                    (*fn)(const char *, union pa_classify_arg *);
+    union pa_classify_arg    tmp;
+
     if (!strcmp(method, "equals"))
-        carddef->method = pa_method_equals;
+        m = pa_method_equals;
     else if (!strcmp(method, "startswith"))
-        carddef->method = pa_method_startswith;
+        m = pa_method_startswith;
     else if (!strcmp(method, "matches"))
-        carddef->method = pa_method_matches;
+        m = pa_method_matches;
+    else if (!strcmp(method, "lt"))
+        m = pa_method_lt;
+    else if (!strcmp(method, "le"))
+        m = pa_method_le;
+    else if (!strcmp(method, "gt"))
+        m = pa_method_gt;
+    else if (!strcmp(method, "ge"))
+        m = pa_method_ge;
+    else if (!strcmp(method, "range"))
+        m = pa_method_range;
     else {
         pa_log("invalid method '%s' in line %d", method, lineno);
-        return -1;
+        return pa_method_unknown;
     }
-    
-    carddef->arg   = pa_xstrdup(arg);
-    
-    return 0;
+
+    if (pa_classify_method_is_numeric(m) &&
+        !pa_classify_numeric_setup(m, arg, &fn, &tmp))
+    {
+        pa_log("invalid numeric argument '%s' for method '%s' in line %d",
+               arg, method, lineno);
+        return pa_method_unknown;
+    }
+
+    return m;
 }
 
 static int flags_parse(int lineno, char *flagdef, uint32_t *flags_ret)
@@ -1,6 +1,8 @@
 #include <stdarg.h>
 
 #include <pulsecore/pulsecore-config.h>
+#include <pulsecore/core-subscribe.h>
+#include <pulsecore/rtclock.h>
 
 #include "context.h"
 #include "module-ext.h"
@@ -12,21 +14,37 @@
 
 static struct pa_policy_context_variable
             *add_variable(struct pa_policy_context *, char *);
+static struct pa_policy_context_variable
+            *find_variable(struct pa_policy_context *, const char *);
 static void delete_variable(struct pa_policy_context *,
                             struct pa_policy_context_variable *);
 
 static struct pa_policy_context_rule
             *add_rule(struct pa_policy_context_variable *,
                       enum pa_classify_method, char*);
-static void  delete_rule(struct pa_policy_context_variable *,
+static void  delete_rule(struct pa_policy_context *,
+                         struct pa_policy_context_variable *,
                          struct pa_policy_context_rule  *);
+static struct pa_policy_context_rule
+            **dispatch_chain(struct pa_policy_context_variable *,
+                             struct pa_policy_context_rule *);
+static struct pa_policy_context_rule
+            *next_equals_rule(struct pa_policy_context_rule *, const char *);
 
 static void  append_action(struct pa_policy_context_rule  *,
                            union pa_policy_context_action *);
-static void  delete_action(struct pa_policy_context_rule  *,
+static void  delete_action(struct pa_policy_context *,
+                           struct pa_policy_context_rule  *,
                            union pa_policy_context_action *);
 static int perform_action(struct userdata *, union pa_policy_context_action *,
                           char *);
+static struct pa_policy_context_history
+            *history_start(struct pa_policy_context *,
+                           struct pa_policy_context_variable *, const char *);
+static void history_copy(char *, const char *);
+static int process_variable(struct userdata *,
+                            struct pa_policy_context_variable *, char *);
+static void process_pending(pa_mainloop_api *, pa_defer_event *, void *);
 
 static int   match_setup(struct pa_policy_match *, enum pa_classify_method,
                          char *, char **);
@@ -36,24 +54,98 @@ static int   value_setup(union pa_policy_value *, enum pa_policy_value_type,
                          va_list);
 static void  value_cleanup(union pa_policy_value *);
 
-static void register_object(struct pa_policy_object *,
+static void index_object(struct pa_policy_context *,
+                         struct pa_policy_object *);
+static void unindex_object(struct pa_policy_context *,
+                           struct pa_policy_object *);
+static struct pa_policy_object **target_chain(struct pa_policy_context *,
+                                              struct pa_policy_object *);
+static void register_object(struct pa_policy_context *,
+                            struct pa_policy_object *,
                             enum pa_policy_object_type,
-                            const char *, void *, int);
-static void unregister_object(struct pa_policy_object *,
-                              enum pa_policy_object_type, const char *,
-                              void *, unsigned long, int);
-static const char *get_object_property(struct pa_policy_object *,const char *);
-static void set_object_property(struct pa_policy_object *,
+                            const char *, void *);
+static void unregister_object(struct pa_policy_object_ref *, const char *);
+static const char *get_object_property(struct pa_policy_context *,
+                                       struct pa_policy_object_ref *,
+                                       const char *);
+static void set_object_property(struct pa_policy_context *,
+                                struct pa_policy_object_ref *,
                                 const char *, const char *);
-static void delete_object_property(struct pa_policy_object *, const char *);
-static pa_proplist *get_object_proplist(struct pa_policy_object *);
-static int object_assert(struct userdata *, struct pa_policy_object *);
-static const char *object_name(struct pa_policy_object *);
-static void fire_object_property_changed_hook(struct pa_policy_object *object);
+static void delete_object_property(struct pa_policy_context *,
+                                   struct pa_policy_object_ref *,
+                                   const char *);
+static struct pa_policy_context_change *
+            find_change(struct pa_policy_context *,
+                        struct pa_policy_object_ref *, int);
+static void commit_changes(struct pa_policy_context *);
+static pa_proplist *get_object_proplist(struct pa_policy_object_ref *);
+static int object_assert(struct userdata *, struct pa_policy_object_ref *);
+static const char *object_name(struct pa_policy_object_ref *);
+static void fire_object_property_changed_hook(pa_core *,
+                                              struct pa_policy_object_ref *);
+static const char *module_name(void *);
+static const char *card_name(void *);
+static const char *sink_name(void *);
+static const char *source_name(void *);
+static const char *sink_input_name(void *);
+static const char *source_output_name(void *);
 
 static unsigned long object_index(enum pa_policy_object_type, void *);
 static const char *object_type_str(enum pa_policy_object_type);
 
+static uint32_t registry_hash(enum pa_policy_object_type, unsigned long);
+
+#define OBJECT_OFFSET(s,m) ((size_t)&(((s *)0)->m))
+
+static const struct pa_policy_object_ops object_ops[pa_policy_object_max] = {
+    [pa_policy_object_module] = {
+        "module",
+        OBJECT_OFFSET(pa_core, modules),
+        OBJECT_OFFSET(struct pa_module, proplist),
+        module_name,
+        FALSE, PA_CORE_HOOK_MAX, PA_SUBSCRIPTION_EVENT_MODULE
+    },
+    [pa_policy_object_card] = {
+        "card",
+        OBJECT_OFFSET(pa_core, cards),
+        OBJECT_OFFSET(struct pa_card, proplist),
+        card_name,
+        FALSE, PA_CORE_HOOK_MAX, PA_SUBSCRIPTION_EVENT_CARD
+    },
+    [pa_policy_object_sink] = {
+        "sink",
+        OBJECT_OFFSET(pa_core, sinks),
+        OBJECT_OFFSET(struct pa_sink, proplist),
+        sink_name,
+        TRUE, PA_CORE_HOOK_SINK_PROPLIST_CHANGED,
+        PA_SUBSCRIPTION_EVENT_SINK
+    },
+    [pa_policy_object_source] = {
+        "source",
+        OBJECT_OFFSET(pa_core, sources),
+        OBJECT_OFFSET(struct pa_source, proplist),
+        source_name,
+        TRUE, PA_CORE_HOOK_SOURCE_PROPLIST_CHANGED,
+        PA_SUBSCRIPTION_EVENT_SOURCE
+    },
+    [pa_policy_object_sink_input] = {
+        "sink-input",
+        OBJECT_OFFSET(pa_core, sink_inputs),
+        OBJECT_OFFSET(struct pa_sink_input, proplist),
+        sink_input_name,
+        TRUE, PA_CORE_HOOK_SINK_INPUT_PROPLIST_CHANGED,
+        PA_SUBSCRIPTION_EVENT_SINK_INPUT
+    },
+    [pa_policy_object_source_output] = {
+        "source-output",
+        OBJECT_OFFSET(pa_core, source_outputs),
+        OBJECT_OFFSET(struct pa_source_output, proplist),
+        source_output_name,
+        TRUE, PA_CORE_HOOK_SOURCE_OUTPUT_PROPLIST_CHANGED,
+        PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT
+    },
+};
+
 
 struct pa_policy_context *pa_policy_context_new(struct userdata *u)
 {
@@ -61,13 +153,28 @@ struct pa_policy_context *pa_policy_context_new(struct userdata *u)
 
     ctx = pa_xmalloc0(sizeof(*ctx));
 
+    ctx->core = u->core;
+
     return ctx;
 }
 
 void pa_policy_context_free(struct pa_policy_context *ctx)
 {
+    struct pa_policy_context_change *chg;
+
     if (ctx != NULL) {
 
+        while ((chg = ctx->changes) != NULL) {
+            ctx->changes = chg->next;
+
+            pa_proplist_free(chg->set);
+            pa_proplist_free(chg->del);
+            pa_xfree(chg);
+        }
+
+        if (ctx->defer != NULL)
+            ctx->mainloop->defer_free(ctx->defer);
+
         while (ctx->variables != NULL)
             delete_variable(ctx, ctx->variables);
 
@@ -75,45 +182,49 @@ void pa_policy_context_free(struct pa_policy_context *ctx)
     }
 }
 
+void pa_policy_context_coalesce(struct userdata *u, const char *coalesce)
+{
+    struct pa_policy_context *ctx;
+
+    pa_assert(u);
+    pa_assert_se((ctx = u->context));
+
+    if (coalesce != NULL) {
+        if (!strcmp(coalesce, "on"))
+            ctx->coalesce = TRUE;
+        else if (strcmp(coalesce, "off"))
+            pa_log("invalid value '%s' for context coalescing", coalesce);
+    }
+
+    if (ctx->coalesce && ctx->defer == NULL) {
+        ctx->mainloop = u->core->mainloop;
+        ctx->defer    = ctx->mainloop->defer_new(ctx->mainloop,
+                                                 process_pending, u);
+        ctx->mainloop->defer_enable(ctx->defer, FALSE);
+    }
+
+    pa_log_info("context coalescing is %s", ctx->coalesce ? "on" : "off");
+}
+
 void pa_policy_context_register(struct userdata *u,
                                 enum pa_policy_object_type what,
                                 const char *name, void *ptr)
 {
-    struct pa_policy_context_variable *var;
-    struct pa_policy_context_rule     *rule;
-    union  pa_policy_context_action   *actn;
-    struct pa_policy_set_property     *setprop;
-    struct pa_policy_del_property     *delprop;
-    struct pa_policy_object           *object;
-    int                                lineno;
-
-    for (var = u->context->variables;   var != NULL;   var = var->next) {
-        for (rule = var->rules;   rule != NULL;   rule = rule->next) {
-            for (actn = rule->actions;  actn != NULL;  actn = actn->any.next) {
-
-                switch (actn->any.type) {
-
-                case pa_policy_set_property:
-                    setprop = &actn->setprop;
-                    lineno  = setprop->lineno;
-                    object  = &setprop->object;
-                    break;
+    struct pa_policy_context *ctx = u->context;
+    struct pa_policy_object  *object;
+    uint32_t                  idx;
 
-                case pa_policy_delete_property:
-                    delprop = &actn->delprop;
-                    lineno  = delprop->lineno;
-                    object  = &delprop->object;
-                    break;
+    if (what <= pa_policy_object_min || what >= pa_policy_object_max)
+        return;
 
-                default:
-                    continue;
-                } /* switch */
+    /* only the targets with this very name or with a pattern can match */
+    idx = pa_policy_hash_string(name) & PA_POLICY_CONTEXT_HASH_MASK;
 
-                register_object(object, what, name, ptr, lineno);
+    for (object = ctx->targets[what][idx];  object;  object = object->tnext)
+        register_object(ctx, object, what, name, ptr);
 
-            }  /* for actn */
-        }  /*  for rule */
-    }  /*  for var */
+    for (object = ctx->patterns[what];  object;  object = object->tnext)
+        register_object(ctx, object, what, name, ptr);
 }
 
 void pa_policy_context_unregister(struct userdata *u,
@@ -122,41 +233,32 @@ void pa_policy_context_unregister(struct userdata *u,
                                   void *ptr,
                                   unsigned long index)
 {
-    struct pa_policy_context_variable *var;
-    struct pa_policy_context_rule     *rule;
-    union  pa_policy_context_action   *actn;
-    struct pa_policy_set_property     *setprop;
-    struct pa_policy_del_property     *delprop;
-    struct pa_policy_object           *object;
-    int                                lineno;
-
-    for (var = u->context->variables;   var != NULL;   var = var->next) {
-        for (rule = var->rules;   rule != NULL;   rule = rule->next) {
-            for (actn = rule->actions;  actn != NULL;  actn = actn->any.next) {
-
-                switch (actn->any.type) {
-
-                case pa_policy_set_property:
-                    setprop = &actn->setprop; 
-                    lineno  = setprop->lineno;
-                    object  = &setprop->object;
-                    break;
-
-                case pa_policy_delete_property:
-                    delprop = &actn->delprop;
-                    lineno  = delprop->lineno;
-                    object  = &delprop->object;
-                    break;
-
-                default:
-                    continue;
-                } /* switch */
-
-                unregister_object(object, type, name, ptr, index, lineno);
+    struct pa_policy_context     *ctx = u->context;
+    struct pa_policy_object_ref **prev;
+    struct pa_policy_object_ref  *ref;
+    int                           removed = FALSE;
+
+    prev = &ctx->registered[registry_hash(type, index)];
+
+    while ((ref = *prev) != NULL) {
+        if (( ptr &&                ptr == ref->ptr             ) ||
+            (!ptr && type == ref->type && index == ref->index)   )
+        {
+            *prev = ref->rnext;
+            unregister_object(ref, name);
+            removed = TRUE;
+        }
+        else {
+            prev = &ref->rnext;
+        }
+    }
 
-            } /* for actn */
-        }  /* for rule */
-    }  /* for var */
+    /*
+     * this is called by the unlink handlers; only if the object was
+     * referenced must the cached handles of its type be revalidated
+     */
+    if (removed && type > pa_policy_object_min && type < pa_policy_object_max)
+        ctx->generation[type]++;
 }
 
 struct pa_policy_context_rule *
@@ -173,7 +275,8 @@ pa_policy_context_add_property_rule(struct userdata *u, char *varname,
 }
 
 void
-pa_policy_context_add_property_action(struct pa_policy_context_rule *rule,
+pa_policy_context_add_property_action(struct userdata            *u,
+                                      struct pa_policy_context_rule *rule,
                                       int                         lineno,
                                       enum pa_policy_object_type  obj_type,
                                       enum pa_classify_method     obj_classify,
@@ -192,8 +295,10 @@ pa_policy_context_add_property_action(struct pa_policy_context_rule *rule,
     setprop->type   = pa_policy_set_property;
     setprop->lineno = lineno;
 
-    setprop->object.type = obj_type;
+    setprop->object.type   = obj_type;
+    setprop->object.lineno = lineno;
     match_setup(&setprop->object.match, obj_classify, obj_name, NULL);
+    index_object(u->context, &setprop->object);
 
     setprop->property = pa_xstrdup(prop_name);
 
@@ -205,7 +310,8 @@ pa_policy_context_add_property_action(struct pa_policy_context_rule *rule,
 }
 
 void
-pa_policy_context_delete_property_action(struct pa_policy_context_rule *rule,
+pa_policy_context_delete_property_action(struct userdata         *u,
+                                         struct pa_policy_context_rule *rule,
                                          int                      lineno,
                                          enum pa_policy_object_type obj_type,
                                          enum pa_classify_method  obj_classify,
@@ -221,8 +327,10 @@ pa_policy_context_delete_property_action(struct pa_policy_context_rule *rule,
     delprop->type   = pa_policy_delete_property;
     delprop->lineno = lineno;
 
-    delprop->object.type = obj_type;
+    delprop->object.type   = obj_type;
+    delprop->object.lineno = lineno;
     match_setup(&delprop->object.match, obj_classify, obj_name, NULL);
+    index_object(u->context, &delprop->object);
 
     delprop->property = pa_xstrdup(prop_name);
 
@@ -232,73 +340,294 @@ pa_policy_context_delete_property_action(struct pa_policy_context_rule *rule,
 int pa_policy_context_variable_changed(struct userdata *u, char *name,
                                        char *value)
 {
-    struct pa_policy_context_variable *var;
+    struct pa_policy_context           *ctx = u->context;
+    struct pa_policy_context_variable  *var;
+    struct pa_policy_context_variable **last;
+
+    if ((var = find_variable(ctx, name)) == NULL)
+        return TRUE;
+
+    if (!ctx->coalesce)
+        return process_variable(u, var, value);
+
+    /*
+     * only the latest value is kept; the rules are run in the order of
+     * arrival either by pa_policy_context_flush() or at the end of the
+     * current main loop iteration
+     */
+    if (var->pending != NULL)
+        pa_xfree(var->pending);
+    else {
+        for (last = &ctx->pending;  *last != NULL;  last = &(*last)->pnext)
+            ;
+
+        *last      = var;
+        var->pnext = NULL;
+    }
+
+    var->pending = pa_xstrdup(value);
+
+    ctx->mainloop->defer_enable(ctx->defer, TRUE);
+
+    return TRUE;
+}
+
+
+static int process_variable(struct userdata                   *u,
+                            struct pa_policy_context_variable *var,
+                            char                              *value)
+{
     struct pa_policy_context_rule     *rule;
+    struct pa_policy_context_rule     *eq;
+    struct pa_policy_context_rule     *res;
     union pa_policy_context_action    *actn;
+    struct pa_policy_context_history  *hist;
+    pa_usec_t                          start;
+    pa_usec_t                          elapsed;
+    uint32_t                           idx;
     int                                success;
 
+    if (!strcmp(value, var->value)) {
+        pa_log_debug("no value change -> no action");
+        return TRUE;
+    }
+
     success = TRUE;
 
-    for (var = u->context->variables;  var != NULL;  var = var->next) {
-        if (!strcmp(name, var->name)) {
-            if (!strcmp(value, var->value))
-                pa_log_debug("no value change -> no action");
-            else {
-                pa_xfree(var->value);
-                var->value = pa_xstrdup(value);
-
-                for (rule = var->rules;  rule != NULL;  rule = rule->next) {
-                    if (rule->match.method(value, &rule->match.arg)) {
-                        for (actn = rule->actions; actn; actn = actn->any.next)
-                        {
-                            if (!perform_action(u, actn, value))
-                                success = FALSE;
-                        }
-                    }
-                }
-            }
-            
-            break;
+    hist  = history_start(u->context, var, value);
+    start = hist->stamp;
+
+    pa_xfree(var->value);
+    var->value = pa_xstrdup(value);
+
+    /*
+     * only the 'equals' rules of the value's hash chain can fire;
+     * merge them with the residual rules to keep the config order
+     */
+    idx = pa_policy_hash_string(value) & PA_POLICY_RULE_HASH_MASK;
+    eq  = var->eqhash[idx];
+    eq  = next_equals_rule(eq, value);
+    res = var->residual;
+
+    while (eq != NULL || res != NULL) {
+        if (eq != NULL && (res == NULL || eq->seqno < res->seqno)) {
+            rule = eq;
+            eq   = next_equals_rule(eq->dnext, value);
+        }
+        else {
+            rule = res;
+            res  = res->dnext;
+
+            if (!rule->match.method(value, &rule->match.arg))
+                continue;
+        }
+
+        hist->nrule++;
+
+        for (actn = rule->actions;  actn;  actn = actn->any.next) {
+            hist->naction++;
+
+            if (!perform_action(u, actn, value))
+                success = FALSE;
+        }
+    }
+
+    /* one proplist update and notification per touched object */
+    commit_changes(u->context);
+
+    elapsed = pa_rtclock_usec() - start;
+
+    hist->duration = elapsed;
+
+    var->nchange++;
+    var->total += elapsed;
+
+    if (elapsed > var->max)
+        var->max = elapsed;
+
+    return success;
+}
+
+/*
+ * The history is a fixed ring of PA_POLICY_HISTORY_DIM entries; the oldest
+ * entry is overwritten and nothing is allocated when a change is recorded.
+ */
+static struct pa_policy_context_history *
+history_start(struct pa_policy_context          *ctx,
+              struct pa_policy_context_variable *var,
+              const char                        *value)
+{
+    struct pa_policy_context_history *hist;
+
+    hist = ctx->history + (ctx->nhistory++ & PA_POLICY_HISTORY_MASK);
+
+    hist->stamp    = pa_rtclock_usec();
+    hist->duration = 0;
+    hist->nrule    = 0;
+    hist->naction  = 0;
+
+    history_copy(hist->name  , var->name);
+    history_copy(hist->oldval, var->value);
+    history_copy(hist->newval, value);
+
+    return hist;
+}
+
+static void history_copy(char *dst, const char *src)
+{
+    size_t len = PA_POLICY_HISTORY_STRLEN - 1;
+
+    if (src == NULL)
+        src = "";
+
+    strncpy(dst, src, len);
+
+    /* do not cut a UTF-8 sequence in half when truncating */
+    if (strlen(src) > len) {
+        while (len > 0 && ((unsigned char)src[len] & 0xC0) == 0x80)
+            len--;
+    }
+
+    dst[len] = '\0';
+}
+
+const struct pa_policy_context_history *
+pa_policy_context_history_get(struct pa_policy_context *ctx, uint32_t i)
+{
+    uint32_t n;
+
+    pa_assert(ctx);
+
+    if ((n = ctx->nhistory) > PA_POLICY_HISTORY_DIM)
+        n = PA_POLICY_HISTORY_DIM;
+
+    if (i >= n)
+        return NULL;
+
+    /* i counts from the oldest entry still in the ring */
+    return ctx->history + ((ctx->nhistory - n + i) & PA_POLICY_HISTORY_MASK);
+}
+
+void pa_policy_context_history_dump(struct pa_policy_context *ctx)
+{
+    const struct pa_policy_context_history *hist;
+    struct pa_policy_context_variable      *var;
+    uint32_t                                i;
+
+    pa_assert(ctx);
+
+    pa_log_info("context history (%u changes recorded)", ctx->nhistory);
+
+    for (i = 0;  (hist = pa_policy_context_history_get(ctx, i)) != NULL;  i++){
+        pa_log_info("  %llu: %s '%s' -> '%s' rules %u actions %u %llu usec",
+                    (unsigned long long)hist->stamp, hist->name,
+                    hist->oldval, hist->newval, hist->nrule, hist->naction,
+                    (unsigned long long)hist->duration);
+    }
+
+    for (var = ctx->variables;  var != NULL;  var = var->next) {
+        if (var->nchange > 0) {
+            pa_log_info("  %s: %u changes total %llu usec max %llu usec",
+                        var->name, var->nchange,
+                        (unsigned long long)var->total,
+                        (unsigned long long)var->max);
         }
     }
+}
+
+/*
+ * Run the rules of the coalesced variables right away. Returns FALSE
+ * if any of them failed.
+ */
+int pa_policy_context_flush(struct userdata *u)
+{
+    struct pa_policy_context          *ctx = u->context;
+    struct pa_policy_context_variable *var;
+    char                              *value;
+    int                                success = TRUE;
+
+    if (ctx->defer != NULL)
+        ctx->mainloop->defer_enable(ctx->defer, FALSE);
+
+    while ((var = ctx->pending) != NULL) {
+        ctx->pending = var->pnext;
+        var->pnext   = NULL;
+
+        value = var->pending;
+        var->pending = NULL;
+
+        pa_log_debug("process deferred context (%s|%s)", var->name, value);
+
+        if (!process_variable(u, var, value))
+            success = FALSE;
+
+        pa_xfree(value);
+    }
 
     return success;
 }
 
+static void process_pending(pa_mainloop_api *m, pa_defer_event *e,
+                            void *userdata)
+{
+    pa_policy_context_flush((struct userdata *)userdata);
+}
+
 
 static
 struct pa_policy_context_variable *add_variable(struct pa_policy_context *ctx,
                                                 char *name)
 {
     struct pa_policy_context_variable *var;
-    struct pa_policy_context_variable *last;
+    uint32_t                           idx;
 
-    for (last = (struct pa_policy_context_variable *)&ctx->variables;
-         last->next != NULL;
-         last = last->next)
-    {
-        var = last->next;
-
-        if (!strcmp(name, var->name))
-            return var;
-    }
+    if ((var = find_variable(ctx, name)) != NULL)
+        return var;
 
     var = pa_xmalloc0(sizeof(*var));
 
     var->name  = pa_xstrdup(name);
     var->value = pa_xstrdup("");
 
-    last->next = var;
+    if (ctx->lastvar == NULL)
+        ctx->variables = var;
+    else
+        ctx->lastvar->next = var;
+
+    ctx->lastvar = var;
+
+    idx = pa_policy_hash_string(name) & PA_POLICY_CONTEXT_HASH_MASK;
+
+    var->hnext = ctx->hash_tbl[idx];
+    ctx->hash_tbl[idx] = var;
 
     pa_log_debug("created context variable '%s'", var->name);
 
     return var;
 }
 
+static struct pa_policy_context_variable *
+find_variable(struct pa_policy_context *ctx, const char *name)
+{
+    struct pa_policy_context_variable *var;
+    uint32_t                           idx;
+
+    idx = pa_policy_hash_string(name) & PA_POLICY_CONTEXT_HASH_MASK;
+
+    for (var = ctx->hash_tbl[idx];  var;  var = var->hnext) {
+        if (!strcmp(name, var->name))
+            return var;
+    }
+
+    return NULL;
+}
+
 static void delete_variable(struct pa_policy_context          *ctx,
                             struct pa_policy_context_variable *variable)
 {
-    struct pa_policy_context_variable *last;
+    struct pa_policy_context_variable  *last;
+    struct pa_policy_context_variable **hprev;
+    uint32_t                            idx;
     
     for (last = (struct pa_policy_context_variable *)&ctx->variables;
          last->next != NULL;
@@ -307,14 +636,31 @@ static void delete_variable(struct pa_policy_context          *ctx,
         if (last->next == variable) {
             last->next = variable->next;
 
+            if (ctx->lastvar == variable)
+                ctx->lastvar = (ctx->variables == NULL) ? NULL : last;
+
+            idx = pa_policy_hash_string(variable->name) &
+                  PA_POLICY_CONTEXT_HASH_MASK;
+
+            for (hprev = &ctx->hash_tbl[idx];
+                 *hprev != NULL;
+                 hprev = &(*hprev)->hnext)
+            {
+                if (*hprev == variable) {
+                    *hprev = variable->hnext;
+                    break;
+                }
+            }
+
 #if 0
             pa_log_debug("delete context variable '%s'", variable->name);
 #endif
 
             pa_xfree(variable->name);
+            pa_xfree(variable->pending);
 
             while (variable->rules != NULL)
-                delete_rule(variable, variable->rules);
+                delete_rule(ctx, variable, variable->rules);
 
             pa_xfree(variable);
 
@@ -331,9 +677,10 @@ add_rule(struct pa_policy_context_variable *variable,
          enum pa_classify_method            method,
          char                              *arg)
 {
-    struct pa_policy_context_rule *rule = pa_xmalloc0(sizeof(*rule));
-    struct pa_policy_context_rule *last;
-    char                          *method_name;
+    struct pa_policy_context_rule  *rule = pa_xmalloc0(sizeof(*rule));
+    struct pa_policy_context_rule  *last;
+    struct pa_policy_context_rule **chain;
+    char                           *method_name;
 
     if (!match_setup(&rule->match, method, arg, &method_name)) {
         pa_log("%s: invalid rule definition (method %s)",
@@ -350,13 +697,25 @@ add_rule(struct pa_policy_context_variable *variable,
 
     last->next = rule;
 
+    rule->seqno = variable->nrule++;
+
+    /* equals rules are hashed by their value, the rest go to residual */
+    for (chain = dispatch_chain(variable, rule);
+         *chain != NULL;
+         chain = &(*chain)->dnext)
+        ;
+
+    *chain = rule;
+
     return rule;
 }
 
-static void delete_rule(struct pa_policy_context_variable *variable,
+static void delete_rule(struct pa_policy_context          *ctx,
+                        struct pa_policy_context_variable *variable,
                         struct pa_policy_context_rule     *rule)
 {
-    struct pa_policy_context_rule *last;
+    struct pa_policy_context_rule  *last;
+    struct pa_policy_context_rule **chain;
 
     for (last = (struct pa_policy_context_rule *)&variable->rules;
          last->next != NULL;
@@ -365,10 +724,20 @@ static void delete_rule(struct pa_policy_context_variable *variable,
         if (last->next == rule) {
             last->next = rule->next;
 
+            for (chain = dispatch_chain(variable, rule);
+                 *chain != NULL;
+                 chain = &(*chain)->dnext)
+            {
+                if (*chain == rule) {
+                    *chain = rule->dnext;
+                    break;
+                }
+            }
+
             match_cleanup(&rule->match);
 
             while (rule->actions != NULL)
-                delete_action(rule, rule->actions);
+                delete_action(ctx, rule, rule->actions);
 
             pa_xfree(rule);
 
@@ -380,6 +749,30 @@ static void delete_rule(struct pa_policy_context_variable *variable,
            __FUNCTION__);
 }
 
+static struct pa_policy_context_rule **
+dispatch_chain(struct pa_policy_context_variable *variable,
+               struct pa_policy_context_rule     *rule)
+{
+    uint32_t idx;
+
+    if (rule->match.method != pa_classify_method_equals)
+        return &variable->residual;
+
+    idx = pa_policy_hash_string(rule->match.arg.string) &
+          PA_POLICY_RULE_HASH_MASK;
+
+    return &variable->eqhash[idx];
+}
+
+static struct pa_policy_context_rule *
+next_equals_rule(struct pa_policy_context_rule *rule, const char *value)
+{
+    while (rule != NULL && strcmp(value, rule->match.arg.string))
+        rule = rule->dnext;
+
+    return rule;
+}
+
 
 static void append_action(struct pa_policy_context_rule  *rule,
                           union pa_policy_context_action *action)
@@ -394,11 +787,13 @@ static void append_action(struct pa_policy_context_rule  *rule,
     last->any.next = action;
 }
 
-static void delete_action(struct pa_policy_context_rule  *rule,
+static void delete_action(struct pa_policy_context       *ctx,
+                          struct pa_policy_context_rule  *rule,
                           union pa_policy_context_action *action)
 {
     union pa_policy_context_action *last;
     struct pa_policy_set_property  *setprop;
+    struct pa_policy_del_property  *delprop;
 
     for (last = (union pa_policy_context_action *)&rule->actions;
          last->any.next != NULL;
@@ -412,12 +807,22 @@ static void delete_action(struct pa_policy_context_rule  *rule,
             case pa_policy_set_property:
                 setprop = &action->setprop;
 
+                unindex_object(ctx, &setprop->object);
                 match_cleanup(&setprop->object.match);
                 free(setprop->property);
                 value_cleanup(&setprop->value);
 
                 break;
 
+            case pa_policy_delete_property:
+                delprop = &action->delprop;
+
+                unindex_object(ctx, &delprop->object);
+                match_cleanup(&delprop->object.match);
+                free(delprop->property);
+
+                break;
+
             default:
                 pa_log("%s(): confused with data structure: invalid action "
                        "type %d", __FUNCTION__, action->any.type);
@@ -440,7 +845,7 @@ static int perform_action(struct userdata                *u,
 {
     struct pa_policy_set_property *setprop;
     struct pa_policy_del_property *delprop;
-    struct pa_policy_object       *object;
+    struct pa_policy_object_ref   *object;
     const char                    *old_value;
     const char                    *prop_value;
     const char                    *objname;
@@ -451,32 +856,36 @@ static int perform_action(struct userdata                *u,
 
     case pa_policy_set_property:
         setprop = &action->setprop;
-        object  = &setprop->object;
 
-        if (!object_assert(u, object))
-            success = FALSE;
-        else {
-            switch (setprop->value.type) {
+        switch (setprop->value.type) {
 
-            case pa_policy_value_constant:
-                prop_value = setprop->value.constant.string;
-                break;
+        case pa_policy_value_constant:
+            prop_value = setprop->value.constant.string;
+            break;
 
-            case pa_policy_value_copy:
-                prop_value = var_value;
-                break;
+        case pa_policy_value_copy:
+            prop_value = var_value;
+            break;
                 
-            default:
-                prop_value = NULL;
-                break;
-            }
-            
-            if (prop_value == NULL)
-                success = FALSE;
-            else {
-                success = TRUE;
+        default:
+            prop_value = NULL;
+            break;
+        }
 
-                old_value = get_object_property(object, setprop->property);
+        if (prop_value == NULL || setprop->object.refs == NULL)
+            success = FALSE;
+        else {
+            success = TRUE;
+
+            /* apply to every matching object in one pass */
+            for (object = setprop->object.refs; object; object = object->next){
+                if (!object_assert(u, object)) {
+                    success = FALSE;
+                    continue;
+                }
+
+                old_value = get_object_property(u->context, object,
+                                                setprop->property);
                 objname   = object_name(object);
                 objtype   = object_type_str(object->type);
                 
@@ -490,7 +899,8 @@ static int perform_action(struct userdata                *u,
                                  objtype, objname, setprop->property,
                                  prop_value);
 
-                    set_object_property(object, setprop->property, prop_value);
+                    set_object_property(u->context, object,
+                                        setprop->property, prop_value);
                 }
             }
         }
@@ -498,20 +908,26 @@ static int perform_action(struct userdata                *u,
 
     case pa_policy_delete_property:
         delprop = &action->delprop;
-        object  = &delprop->object;
 
-        if (!object_assert(u, object))
+        if (delprop->object.refs == NULL)
             success = FALSE;
         else {
             success = TRUE;
 
-            objname = object_name(object);
-            objtype = object_type_str(object->type);
+            for (object = delprop->object.refs; object; object = object->next){
+                if (!object_assert(u, object)) {
+                    success = FALSE;
+                    continue;
+                }
+
+                objname = object_name(object);
+                objtype = object_type_str(object->type);
             
-            pa_log_debug("deleting %s '%s' property '%s'",
-                         objtype, objname, delprop->property);
+                pa_log_debug("deleting %s '%s' property '%s'",
+                             objtype, objname, delprop->property);
             
-            delete_object_property(object, delprop->property);
+                delete_object_property(u->context, object, delprop->property);
+            }
         }
         break;
 
@@ -551,6 +967,20 @@ static int match_setup(struct pa_policy_match  *match,
         memset(&match->arg, 0, sizeof(match->arg));
         break;
 
+    case pa_method_lt:
+    case pa_method_le:
+    case pa_method_gt:
+    case pa_method_ge:
+    case pa_method_range:
+        method_name = (char *)pa_classify_method_str(method);
+        if (!pa_classify_numeric_setup(method, arg, &match->method,
+                                       &match->arg))
+        {
+            memset(match, 0, sizeof(*match));
+            success = FALSE;
+        }
+        break;
+
     case pa_method_matches:
         method_name = "matches";
         if (regcomp(&match->arg.rexp, arg, 0) == 0) {
@@ -575,10 +1005,7 @@ static int match_setup(struct pa_policy_match  *match,
 
 static void match_cleanup(struct pa_policy_match *match)
 {
-    if (match->method == pa_classify_method_matches)
-        regfree(&match->arg.rexp);
-    else
-        pa_xfree((void *)match->arg.string);
+    pa_classify_arg_cleanup(match->method, &match->arg);
 
     memset(match, 0, sizeof(*match));
 }
@@ -637,60 +1064,162 @@ static void value_cleanup(union pa_policy_value *value)
     }
 }
 
-static void register_object(struct pa_policy_object *object,
-                            enum pa_policy_object_type type,
-                            const char *name, void *ptr, int lineno)
+static void index_object(struct pa_policy_context *ctx,
+                         struct pa_policy_object  *object)
+{
+    struct pa_policy_object **chain;
+
+    object->refs = NULL;
+
+    if ((chain = target_chain(ctx, object)) != NULL) {
+        /* keep the config order within the chain */
+        while (*chain != NULL)
+            chain = &(*chain)->tnext;
+
+        *chain = object;
+    }
+}
+
+static void unindex_object(struct pa_policy_context *ctx,
+                           struct pa_policy_object  *object)
 {
-    const char    *type_str;
+    struct pa_policy_object     **chain;
+    struct pa_policy_object_ref  *ref;
+    struct pa_policy_object_ref **rprev;
+
+    if ((chain = target_chain(ctx, object)) != NULL) {
+        for (;  *chain != NULL;  chain = &(*chain)->tnext) {
+            if (*chain == object) {
+                *chain = object->tnext;
+                break;
+            }
+        }
+    }
+
+    while ((ref = object->refs) != NULL) {
+        object->refs = ref->next;
+
+        rprev = &ctx->registered[registry_hash(ref->type, ref->index)];
+
+        for (;  *rprev != NULL;  rprev = &(*rprev)->rnext) {
+            if (*rprev == ref) {
+                *rprev = ref->rnext;
+                break;
+            }
+        }
+
+        pa_xfree(ref);
+    }
+
+    object->tnext = NULL;
+}
+
+static struct pa_policy_object **target_chain(struct pa_policy_context *ctx,
+                                              struct pa_policy_object  *object)
+{
+    enum pa_policy_object_type type = object->type;
+    uint32_t                   idx;
+
+    if (type <= pa_policy_object_min || type >= pa_policy_object_max ||
+        object->match.method == NULL)
+        return NULL;
+
+    if (object->match.method != pa_classify_method_equals)
+        return &ctx->patterns[type];
+
+    idx = pa_policy_hash_string(object->match.arg.string) &
+          PA_POLICY_CONTEXT_HASH_MASK;
+
+    return &ctx->targets[type][idx];
+}
+
+static void register_object(struct pa_policy_context   *ctx,
+                            struct pa_policy_object    *object,
+                            enum pa_policy_object_type  type,
+                            const char                 *name,
+                            void                       *ptr)
+{
+    struct pa_policy_object_ref *ref;
+    const char                  *type_str;
+    uint32_t                     idx;
 
     if (object->type == type && object->match.method(name,&object->match.arg)){
 
         type_str = object_type_str(type);
 
-        if (object->ptr != NULL) {
-            pa_log("multiple match for %s '%s' (line %d in config file)",
-                   type_str, name, lineno);
+        for (ref = object->refs;  ref != NULL;  ref = ref->next) {
+            if (ref->ptr == ptr) {
+                pa_log_debug("%s '%s' is already registered for context-rule "
+                             "(line %d in config file)", type_str, name,
+                             object->lineno);
+                return;
+            }
         }
-        else {
-            pa_log_debug("registering context-rule for %s '%s' "
-                         "(line %d in config file)", type_str, name, lineno);
 
-            object->ptr   = ptr;
-            object->index = object_index(type, ptr);
+        pa_log_debug("registering context-rule for %s '%s' "
+                     "(line %d in config file)", type_str, name,
+                     object->lineno);
 
-        }
+        ref = pa_xnew0(struct pa_policy_object_ref, 1);
+
+        /* the type specific operations are resolved once, here */
+        ref->target = object;
+        ref->ops    = &object_ops[type];
+        ref->type   = type;
+        ref->ptr    = ptr;
+        ref->index  = object_index(type, ptr);
+        ref->gen    = ctx->generation[type];
+
+        ref->next    = object->refs;
+        object->refs = ref;
+
+        idx = registry_hash(type, ref->index);
+
+        ref->rnext = ctx->registered[idx];
+        ctx->registered[idx] = ref;
     }
 }
 
-static void unregister_object(struct pa_policy_object *object,
-                              enum pa_policy_object_type type,
-                              const char *name,
-                              void *ptr,
-                              unsigned long index,
-                              int lineno)
+static void unregister_object(struct pa_policy_object_ref *ref,
+                              const char *name)
 {
-    if (( ptr &&                ptr == object->ptr             ) ||
-        (!ptr && type == object->type && index == object->index)   ) {
+    struct pa_policy_object      *object = ref->target;
+    struct pa_policy_object_ref **prev;
 
-        pa_log_debug("unregistering context-rule for %s '%s' "
-                     "(line %d in config file)",
-                     object_type_str(object->type), name, lineno);
+    pa_log_debug("unregistering context-rule for %s '%s' "
+                 "(line %d in config file)",
+                 object_type_str(object->type), name, object->lineno);
 
-        object->ptr   = NULL;
-        object->index = PA_IDXSET_INVALID;
+    for (prev = &object->refs;  *prev != NULL;  prev = &(*prev)->next) {
+        if (*prev == ref) {
+            *prev = ref->next;
+            break;
+        }
     }
+
+    pa_xfree(ref);
 }
 
 
-static const char *get_object_property(struct pa_policy_object *object,
-                                       const char *property)
+static const char *get_object_property(struct pa_policy_context    *ctx,
+                                       struct pa_policy_object_ref *object,
+                                       const char               *property)
 {
+    struct pa_policy_context_change *chg;
     pa_proplist *proplist;
     const char  *propval;
     const char  *value = "<undefined>";
 
     if (object->ptr != NULL) {
 
+        /* pending changes shadow the current value */
+        if ((chg = find_change(ctx, object, FALSE)) != NULL) {
+            if (pa_proplist_contains(chg->del, property))
+                return value;
+
+            if ((propval = pa_proplist_gets(chg->set, property)) != NULL)
+                return propval[0] ? propval : value;
+        }
 
         if ((proplist = get_object_proplist(object)) != NULL) {
             propval = pa_proplist_gets(proplist, property);
@@ -703,99 +1232,134 @@ static const char *get_object_property(struct pa_policy_object *object,
     return value;
 }
 
-static void set_object_property(struct pa_policy_object *object,
+static void set_object_property(struct pa_policy_context    *ctx,
+                                struct pa_policy_object_ref *object,
                                 const char *property, const char *value)
 {
-    pa_proplist *proplist;
+    struct pa_policy_context_change *chg;
 
-    if (object->ptr != NULL) {
-        if ((proplist = get_object_proplist(object)) != NULL) {
-            pa_proplist_sets(proplist, property, value);
-            fire_object_property_changed_hook(object);
-        }
+    if (object->ptr != NULL && get_object_proplist(object) != NULL) {
+        chg = find_change(ctx, object, TRUE);
+
+        pa_proplist_unset(chg->del, property);
+        pa_proplist_sets(chg->set, property, value);
     }
 }
 
-static void delete_object_property(struct pa_policy_object *object,
+static void delete_object_property(struct pa_policy_context    *ctx,
+                                   struct pa_policy_object_ref *object,
                                    const char *property)
 {
-    pa_proplist *proplist;
+    struct pa_policy_context_change *chg;
 
-    if (object->ptr != NULL) {
-        if ((proplist = get_object_proplist(object)) != NULL) {
-            pa_proplist_unset(proplist, property);
-            fire_object_property_changed_hook(object);
-        }
+    if (object->ptr != NULL && get_object_proplist(object) != NULL) {
+        chg = find_change(ctx, object, TRUE);
+
+        pa_proplist_unset(chg->set, property);
+        pa_proplist_sets(chg->del, property, "");
     }
 }
 
-static pa_proplist *get_object_proplist(struct pa_policy_object *object)
+static struct pa_policy_context_change *
+find_change(struct pa_policy_context *ctx, struct pa_policy_object_ref *object,
+            int create)
 {
-    pa_proplist *proplist;
+    struct pa_policy_context_change *chg;
 
-    switch (object->type) {
+    for (chg = ctx->changes;  chg != NULL;  chg = chg->next) {
+        if (chg->object.ptr == object->ptr)
+            return chg;
+    }
 
-    case pa_policy_object_module:
-        proplist = ((struct pa_module *)object->ptr)->proplist;
-        break;
+    if (!create)
+        return NULL;
 
-    case pa_policy_object_card:
-        proplist = ((struct pa_card *)object->ptr)->proplist;
-        break;
+    chg = pa_xnew0(struct pa_policy_context_change, 1);
 
-    case pa_policy_object_sink:
-        proplist = ((struct pa_sink *)object->ptr)->proplist;
-        break;
-        
-    case pa_policy_object_source:
-        proplist = ((struct pa_source *)object->ptr)->proplist;
-        break;
-        
-    case pa_policy_object_sink_input:
-        proplist = ((struct pa_sink_input *)object->ptr)->proplist;
-        break;
-        
-    case pa_policy_object_source_output:
-        proplist = ((struct pa_source_output *)object->ptr)->proplist;
-        break;
-        
-    default:
-        proplist = NULL;
-        break;
+    chg->object.ops   = object->ops;
+    chg->object.type  = object->type;
+    chg->object.ptr   = object->ptr;
+    chg->object.index = object->index;
+    chg->set  = pa_proplist_new();
+    chg->del  = pa_proplist_new();
+    chg->next = ctx->changes;
+
+    ctx->changes = chg;
+
+    return chg;
+}
+
+static void commit_changes(struct pa_policy_context *ctx)
+{
+    struct pa_policy_context_change *chg;
+    pa_proplist                     *proplist;
+    const char                      *key;
+    const char                      *old;
+    const char                      *new;
+    void                            *state;
+    int                              changed;
+
+    while ((chg = ctx->changes) != NULL) {
+        ctx->changes = chg->next;
+
+        if ((proplist = get_object_proplist(&chg->object)) != NULL) {
+            changed = FALSE;
+
+            for (state = NULL; (key = pa_proplist_iterate(chg->del, &state));){
+                if (pa_proplist_contains(proplist, key)) {
+                    pa_proplist_unset(proplist, key);
+                    changed = TRUE;
+                }
+            }
+
+            for (state = NULL; (key = pa_proplist_iterate(chg->set, &state));){
+                old = pa_proplist_gets(proplist, key);
+                new = pa_proplist_gets(chg->set, key);
+
+                if (old == NULL || strcmp(old, new)) {
+                    changed = TRUE;
+                    break;
+                }
+            }
+
+            if (changed) {
+                pa_proplist_update(proplist, PA_UPDATE_REPLACE, chg->set);
+                fire_object_property_changed_hook(ctx->core, &chg->object);
+            }
+        }
+
+        pa_proplist_free(chg->set);
+        pa_proplist_free(chg->del);
+        pa_xfree(chg);
     }
+}
 
-    return proplist;
+static pa_proplist *get_object_proplist(struct pa_policy_object_ref *object)
+{
+    return *(pa_proplist **)((char *)object->ptr + object->ops->proplist);
 }
 
 
-static int object_assert(struct userdata *u, struct pa_policy_object *object)
+static int object_assert(struct userdata *u,struct pa_policy_object_ref *object)
 {
-    void *ptr;
+    struct pa_policy_context *ctx;
+    pa_idxset                *objects;
 
     pa_assert(u);
     pa_assert(u->core);
+    pa_assert_se((ctx = u->context));
 
     if (object->ptr != NULL && object->index != PA_IDXSET_INVALID) {
 
-        switch (object->type) {
-
-        case pa_policy_object_module:
-            ptr = pa_idxset_get_by_index(u->core->modules, object->index);
-
-            if (ptr != object->ptr)
-                break;
-
+        /* nothing of this type was unlinked since the last check */
+        if (object->gen == ctx->generation[object->type])
             return TRUE;
 
-        case pa_policy_object_card:
-        case pa_policy_object_sink:
-        case pa_policy_object_source:
-        case pa_policy_object_sink_input:
-        case pa_policy_object_source_output:
-            return TRUE;
+        objects = *(pa_idxset **)((char *)u->core + object->ops->objects);
 
-        default:
-            break;
+        if (pa_idxset_get_by_index(objects, object->index) == object->ptr) {
+            object->gen = ctx->generation[object->type];
+            return TRUE;
         }
     }
     
@@ -804,85 +1368,51 @@ static int object_assert(struct userdata *u, struct pa_policy_object *object)
     return FALSE;
 }
 
-static const char *object_name(struct pa_policy_object *object)
+static const char *object_name(struct pa_policy_object_ref *object)
 {
-    const char *name;
-
-    switch (object->type) {
-
-    case pa_policy_object_module:
-        name = pa_module_ext_get_name((struct pa_module *)object->ptr);
-        break;
+    return object->ops->name(object->ptr);
+}
 
-    case pa_policy_object_card:
-        name = pa_card_ext_get_name((struct pa_card *)object->ptr);
-        break;
+static void fire_object_property_changed_hook(pa_core *core,
+                                              struct pa_policy_object_ref *obj)
+{
+    const struct pa_policy_object_ops *ops = obj->ops;
 
-    case pa_policy_object_sink:
-        name = pa_sink_ext_get_name((struct pa_sink *)object->ptr);
-        break;
-        
-    case pa_policy_object_source:
-        name = pa_source_ext_get_name((struct pa_source *)object->ptr);
-        break;
-        
-    case pa_policy_object_sink_input:
-        name = pa_sink_input_ext_get_name((struct pa_sink_input *)object->ptr);
-        break;
-        
-    case pa_policy_object_source_output:
-        name = pa_source_output_ext_get_name(
-                     (struct pa_source_output *)object->ptr);
-        break;
-        
-    default:
-        name = "<unknown>";
-        break;
+    if (ops->notify) {
+        pa_subscription_post(core, ops->event | PA_SUBSCRIPTION_EVENT_CHANGE,
+                             obj->index);
+        pa_hook_fire(&core->hooks[ops->hook], obj->ptr);
     }
+}
 
-    return name;
+static const char *module_name(void *ptr)
+{
+    return pa_module_ext_get_name((struct pa_module *)ptr);
 }
 
-static void fire_object_property_changed_hook(struct pa_policy_object *object)
+static const char *card_name(void *ptr)
 {
-    pa_core                 *core;
-    pa_core_hook_t           hook;
-    struct pa_sink          *sink;
-    struct pa_source        *src;
-    struct pa_sink_input    *sinp;
-    struct pa_source_output *sout;
+    return pa_card_ext_get_name((struct pa_card *)ptr);
+}
 
-   switch (object->type) {
+static const char *sink_name(void *ptr)
+{
+    return pa_sink_ext_get_name((struct pa_sink *)ptr);
+}
 
-    case pa_policy_object_sink:
-        sink = object->ptr;
-        core = sink->core;
-        hook = PA_CORE_HOOK_SINK_PROPLIST_CHANGED;
-        break;
-        
-    case pa_policy_object_source:
-        src  = object->ptr;
-        core = src->core;
-        hook = PA_CORE_HOOK_SOURCE_PROPLIST_CHANGED;
-        break;
-        
-    case pa_policy_object_sink_input:
-        sinp = object->ptr;
-        core = sinp->core;
-        hook = PA_CORE_HOOK_SINK_INPUT_PROPLIST_CHANGED;
-        break;
-        
-    case pa_policy_object_source_output:
-        sout = object->ptr;
-        core = sout->core;
-        hook = PA_CORE_HOOK_SOURCE_OUTPUT_PROPLIST_CHANGED;
-        break;
-        
-    default:
-        return;
-    }
+static const char *source_name(void *ptr)
+{
+    return pa_source_ext_get_name((struct pa_source *)ptr);
+}
 
-   pa_hook_fire(&core->hooks[hook], object->ptr);
+static const char *sink_input_name(void *ptr)
+{
+    return pa_sink_input_ext_get_name((struct pa_sink_input *)ptr);
+}
+
+static const char *source_output_name(void *ptr)
+{
+    return pa_source_output_ext_get_name((struct pa_source_output *)ptr);
 }
 
 static unsigned long object_index(enum pa_policy_object_type type, void *ptr)
@@ -908,15 +1438,17 @@ static unsigned long object_index(enum pa_policy_object_type type, void *ptr)
 
 static const char *object_type_str(enum pa_policy_object_type type)
 {
-    switch (type) {
-    case pa_policy_object_module:         return "module";
-    case pa_policy_object_card:           return "card";
-    case pa_policy_object_sink:           return "sink";
-    case pa_policy_object_source:         return "source";
-    case pa_policy_object_sink_input:     return "sink-input";
-    case pa_policy_object_source_output:  return "source-output";
-    default:                              return "<unknown>";
-    }
+    if (type <= pa_policy_object_min || type >= pa_policy_object_max)
+        return "<unknown>";
+
+    return object_ops[type].type_str;
+}
+
+static uint32_t registry_hash(enum pa_policy_object_type type,
+                              unsigned long              index)
+{
+    return (38501 * ((uint32_t)type + (uint32_t)index)) &
+           PA_POLICY_CONTEXT_HASH_MASK;
 }
 
 /*
@@ -1,8 +1,23 @@
 #ifndef foopolicycontextfoo
 #define foopolicycontextfoo
 
+#include <pulse/def.h>
+#include <pulse/proplist.h>
+
 #include "classify.h"
 
+#define PA_POLICY_CONTEXT_HASH_BITS  6
+#define PA_POLICY_CONTEXT_HASH_DIM   (1 << PA_POLICY_CONTEXT_HASH_BITS)
+#define PA_POLICY_CONTEXT_HASH_MASK  (PA_POLICY_CONTEXT_HASH_DIM - 1)
+
+#define PA_POLICY_RULE_HASH_BITS     4
+#define PA_POLICY_RULE_HASH_DIM      (1 << PA_POLICY_RULE_HASH_BITS)
+#define PA_POLICY_RULE_HASH_MASK     (PA_POLICY_RULE_HASH_DIM - 1)
+
+#define PA_POLICY_HISTORY_DIM        64   /* must be a power of 2 */
+#define PA_POLICY_HISTORY_MASK       (PA_POLICY_HISTORY_DIM - 1)
+#define PA_POLICY_HISTORY_STRLEN     32   /* longer strings are truncated */
+
 enum pa_policy_action_type {
     pa_policy_action_unknown = 0,
     pa_policy_action_min = pa_policy_action_unknown,
@@ -43,11 +58,33 @@ struct pa_policy_match {
     union pa_classify_arg               arg;
 };
 
-struct pa_policy_object {
+struct pa_policy_object_ops {           /* type specific operations */
+    const char                         *type_str;
+    size_t                              objects;  /* idxset offs. in core */
+    size_t                              proplist; /* proplist offs. in obj. */
+    const char                       *(*name)(void *);
+    int                                 notify;   /* fire hook & event */
+    pa_core_hook_t                      hook;
+    pa_subscription_event_type_t        event;
+};
+
+struct pa_policy_object_ref {           /* an object matching a target */
+    struct pa_policy_object_ref        *next;   /* next in the target's set */
+    struct pa_policy_object_ref        *rnext;  /* next in registry bucket */
+    struct pa_policy_object            *target;
+    const struct pa_policy_object_ops  *ops;
     enum pa_policy_object_type          type;
-    struct pa_policy_match              match;
     void                               *ptr;
     unsigned long                       index;
+    uint32_t                            gen;    /* generation when checked */
+};
+
+struct pa_policy_object {
+    enum pa_policy_object_type          type;
+    struct pa_policy_match              match;
+    struct pa_policy_object_ref        *refs;   /* all matching objects */
+    int                                 lineno; /* of the owning action */
+    struct pa_policy_object            *tnext;  /* next target of same key */
 };
 
 struct pa_policy_value_constant {
@@ -96,24 +133,71 @@ union pa_policy_context_action {
 
 struct pa_policy_context_rule {
     struct pa_policy_context_rule      *next;
+    struct pa_policy_context_rule      *dnext; /* next in dispatch chain */
+    int                                 seqno; /* position within variable */
     struct pa_policy_match              match; /* for the variable value */
     union pa_policy_context_action     *actions;
 };
 
 struct pa_policy_context_variable {
     struct pa_policy_context_variable  *next;
+    struct pa_policy_context_variable  *hnext; /* next in the hash chain */
     char                               *name;
     char                               *value;
     struct pa_policy_context_rule      *rules;
+    int                                 nrule; /* rules ever added */
+    struct pa_policy_context_rule      *eqhash[PA_POLICY_RULE_HASH_DIM];
+    struct pa_policy_context_rule      *residual; /* non-equals rules */
+    struct pa_policy_context_variable  *pnext;    /* next pending variable */
+    char                               *pending;  /* value to be processed */
+    uint32_t                            nchange;  /* # of value changes */
+    pa_usec_t                           total;    /* time spent on changes */
+    pa_usec_t                           max;      /* longest single change */
+};
+
+struct pa_policy_context_history {     /* one variable change */
+    pa_usec_t                           stamp;    /* pa_rtclock_usec() */
+    pa_usec_t                           duration; /* time spent in actions */
+    uint32_t                            nrule;    /* rules fired */
+    uint32_t                            naction;  /* actions executed */
+    char                                name  [PA_POLICY_HISTORY_STRLEN];
+    char                                oldval[PA_POLICY_HISTORY_STRLEN];
+    char                                newval[PA_POLICY_HISTORY_STRLEN];
+};
+
+struct pa_policy_context_change {      /* pending changes of one object */
+    struct pa_policy_context_change    *next;
+    struct pa_policy_object_ref         object;
+    pa_proplist                        *set;  /* properties to set */
+    pa_proplist                        *del;  /* properties to delete */
 };
 
 struct pa_policy_context {
-    struct pa_policy_context_variable  *variables;
+    struct pa_policy_context_variable  *variables; /* in definition order */
+    struct pa_policy_context_variable  *lastvar;   /* tail of variables */
+    struct pa_policy_context_variable  *hash_tbl[PA_POLICY_CONTEXT_HASH_DIM];
+    /* action targets by object type; 'equals' names hashed */
+    struct pa_policy_object            *targets[pa_policy_object_max]
+                                               [PA_POLICY_CONTEXT_HASH_DIM];
+    struct pa_policy_object            *patterns[pa_policy_object_max];
+    /* objects bound to targets, hashed by object type and index */
+    struct pa_policy_object_ref        *registered[PA_POLICY_CONTEXT_HASH_DIM];
+    struct pa_policy_context_change    *changes;  /* not yet committed */
+    pa_core                            *core;
+    uint32_t                            generation[pa_policy_object_max];
+    int                                 coalesce; /* defer var. processing */
+    pa_mainloop_api                    *mainloop;
+    pa_defer_event                     *defer;    /* to process pending */
+    struct pa_policy_context_variable  *pending;  /* vars. w/ pending value */
+    /* ring buffer of the last variable changes */
+    struct pa_policy_context_history    history[PA_POLICY_HISTORY_DIM];
+    uint32_t                            nhistory; /* changes ever recorded */
 };
 
 
 struct pa_policy_context *pa_policy_context_new(struct userdata *);
 void pa_policy_context_free(struct pa_policy_context *);
+void pa_policy_context_coalesce(struct userdata *, const char *);
 
 void pa_policy_context_register(struct userdata *, enum pa_policy_object_type,
                                 const char *, void *);
@@ -125,19 +209,26 @@ struct pa_policy_context_rule
     *pa_policy_context_add_property_rule(struct userdata *, char *,
                                          enum pa_classify_method, char *);
 
-void pa_policy_context_add_property_action(struct pa_policy_context_rule *,int,
+void pa_policy_context_add_property_action(struct userdata *,
+                                           struct pa_policy_context_rule *,int,
                                            enum pa_policy_object_type,
                                            enum pa_classify_method, char *,
                                            char *,
                                            enum pa_policy_value_type, ...);
 
-void pa_policy_context_delete_property_action(struct pa_policy_context_rule *,
+void pa_policy_context_delete_property_action(struct userdata *,
+                                              struct pa_policy_context_rule *,
                                               int,
                                               enum pa_policy_object_type,
                                               enum pa_classify_method,
                                               char *, char *);
 
 int pa_policy_context_variable_changed(struct userdata *, char *, char *);
+int pa_policy_context_flush(struct userdata *);
+
+const struct pa_policy_context_history *
+    pa_policy_context_history_get(struct pa_policy_context *, uint32_t);
+void pa_policy_context_history_dump(struct pa_policy_context *);
 
 #endif
 
@@ -30,25 +30,23 @@
 #define POLICY_STREAM_INFO          "stream_info"
 #define POLICY_ACTIONS              "audio_actions"
 #define POLICY_STATUS               "status"
+#define POLICY_GROUP_STATS          "group_stats"
+#define POLICY_CONTEXT_HISTORY      "context_history"
+#define POLICY_CONTEXT_DUMP         "context_history_dump"
+
+#define POLICY_ACTIONS_SIGNATURE    "ua{saa(sv)}"
 
 
 #define STRUCT_OFFSET(s,m) ((char *)&(((s *)0)->m) - (char *)0)
 
-struct pa_policy_dbusif {
-    pa_dbus_connection *conn;
-    char               *ifnam;   /* signal interface */
-    char               *mypath;  /* my signal path */
-    char               *pdpath;  /* policy daemon's signal path */
-    char               *pdnam;   /* policy daemon's D-Bus name */
-    char               *admrule; /* match rule to catch name changes */
-    char               *actrule; /* match rule to catch action signals */
-    char               *strrule; /* match rule to catch stream info signals */
-    int                 regist;  /* wheter or not registered to policy daemon*/
-};
+#define PHASH_DIM                   32   /* max. slots of a perfect hash */
+#define PHASH_SEEDS                 1024 /* seeds tried per hash size */
 
-struct actdsc {                 /* action descriptor */
-    const char         *name;
-    int               (*parser)(struct userdata *u, DBusMessageIter *iter);
+struct phash {                  /* perfect hash of descriptor names */
+    uint32_t            seed;
+    uint32_t            mask;
+    const char         *keys[PHASH_DIM];
+    int                 index[PHASH_DIM];
 };
 
 struct argdsc {                 /* argument descriptor for actions */
@@ -62,6 +60,7 @@ struct argrt {                  /* audio_route arguments */
     char               *device;
     char               *mode;
     char               *hwid;
+    enum pa_policy_route_class class;
 };
 
 struct argvol {                 /* volume_limit arguments */
@@ -72,11 +71,13 @@ struct argvol {                 /* volume_limit arguments */
 struct argcork {                /* audio_cork arguments */
     char               *group;
     char               *cork;
+    int                 val;
 };
 
 struct argmute {
     char               *device;
     char               *mute;
+    int                 val;
 };
 
 struct argctx {                 /* context arguments */
@@ -84,22 +85,170 @@ struct argctx {                 /* context arguments */
     char               *value;
 };
 
-static int action_parser(DBusMessageIter *, struct argdsc *, void *, int);
-static int audio_route_parser(struct userdata *, DBusMessageIter *);
-static int volume_limit_parser(struct userdata *, DBusMessageIter *);
-static int audio_cork_parser(struct userdata *, DBusMessageIter *);
-static int audio_mute_parser(struct userdata *, DBusMessageIter *);
-static int context_parser(struct userdata *, DBusMessageIter *);
+union actargs {                 /* decoded arguments of any action */
+    struct argrt        route;
+    struct argvol       volume;
+    struct argcork      cork;
+    struct argmute      mute;
+    struct argctx       context;
+};
+
+struct actdsc {                 /* action descriptor */
+    const char         *name;
+    struct argdsc      *args;   /* argument descriptors */
+    int               (*check)(union actargs *);
+    int               (*apply)(struct userdata *, union actargs *);
+    int                 target; /* offset of the merge key or -1 */
+    struct phash        hash;   /* argument names */
+};
+
+struct actcmd {                 /* one decoded action */
+    struct actdsc      *action;
+    union actargs       args;
+    int                 owner;  /* index of the decision it came with */
+    int                 skip;   /* superseded by a later command */
+};
+
+struct actdec {                 /* one audio_actions message */
+    DBusMessage        *msg;    /* holds the strings of the commands */
+    uint32_t            txid;
+    int                 success;
+};
+
+struct actbuf {                 /* decoded actions of decision(s) */
+    struct actcmd      *cmds;
+    int                 ncmd;
+    int                 size;
+    struct actdec      *decs;
+    int                 ndec;
+    int                 decsize;
+};
+
+struct pa_policy_dbusif {
+    pa_dbus_connection *conn;
+    char               *ifnam;   /* signal interface */
+    char               *mypath;  /* my signal path */
+    char               *pdpath;  /* policy daemon's signal path */
+    char               *pdnam;   /* policy daemon's D-Bus name */
+    char               *admrule; /* match rule to catch name changes */
+    char               *actrule; /* match rule to catch action signals */
+    char               *strrule; /* match rule to catch stream info signals */
+    int                 regist;  /* wheter or not registered to policy daemon*/
+    int                 coalesce;/* merge queued audio_actions decisions */
+    pa_mainloop_api    *mainloop;
+    pa_defer_event     *defer;   /* to apply the queued decisions */
+    struct actbuf       queue;   /* decisions not yet applied */
+};
+
+static void build_dispatch_hashes(void);
+static int  phash_build(struct phash *, const char **, int);
+static int  phash_lookup(struct phash *, const char *);
+static uint32_t phash_value(uint32_t, const char *);
+
+static int  decode_actions(DBusMessage *, struct actbuf *);
+static int  decode_command(DBusMessageIter *, struct actcmd *);
+static struct actcmd *new_command(struct actbuf *, struct actdsc *);
+static void queue_decision(struct actbuf *, DBusMessage *, uint32_t);
+static void merge_commands(struct actbuf *);
+static void apply_decisions(struct userdata *, struct actbuf *, int);
+static void apply_queued(pa_mainloop_api *, pa_defer_event *, void *);
+static void free_decisions(struct actbuf *);
+
+static int  audio_route_check(union actargs *);
+static int  audio_route_apply(struct userdata *, union actargs *);
+static int  volume_limit_check(union actargs *);
+static int  volume_limit_apply(struct userdata *, union actargs *);
+static int  audio_cork_check(union actargs *);
+static int  audio_cork_apply(struct userdata *, union actargs *);
+static int  audio_mute_check(union actargs *);
+static int  audio_mute_apply(struct userdata *, union actargs *);
+static int  context_check(union actargs *);
+static int  context_apply(struct userdata *, union actargs *);
 
 static DBusHandlerResult filter(DBusConnection *, DBusMessage *, void *);
 static void handle_admin_message(struct userdata *, DBusMessage *);
 static void handle_info_message(struct userdata *, DBusMessage *);
 static void handle_action_message(struct userdata *, DBusMessage *);
+static void handle_stats_request(struct userdata *, DBusConnection *,
+                                 DBusMessage *);
+static int  append_group_stats(DBusMessageIter *, struct pa_policy_group *);
+static void handle_history_request(struct userdata *, DBusConnection *,
+                                   DBusMessage *);
+static void handle_dump_request(struct userdata *, DBusConnection *,
+                                DBusMessage *);
+static int  append_context_history(DBusMessageIter *,
+                                   struct pa_policy_context *);
+static int  append_variable_times(DBusMessageIter *,
+                                  struct pa_policy_context *);
 static void registration_cb(DBusPendingCall *, void *);
 static int  register_to_pdp(struct pa_policy_dbusif *, struct userdata *);
 static int  signal_status(struct userdata *, uint32_t, uint32_t);
 static void pa_policy_free_dbusif(struct pa_policy_dbusif *,struct userdata *);
 
+#define ARG_OFFSET(m) STRUCT_OFFSET(union actargs, m)
+
+static struct argdsc route_args[] = {
+    {"type"    , ARG_OFFSET(route.type)      , DBUS_TYPE_STRING },
+    {"device"  , ARG_OFFSET(route.device)    , DBUS_TYPE_STRING },
+    {"mode"    , ARG_OFFSET(route.mode)      , DBUS_TYPE_STRING },
+    {"hwid"    , ARG_OFFSET(route.hwid)      , DBUS_TYPE_STRING },
+    {  NULL    ,            0                , DBUS_TYPE_INVALID}
+};
+
+static struct argdsc volume_args[] = {
+    {"group"   , ARG_OFFSET(volume.group)    , DBUS_TYPE_STRING },
+    {"limit"   , ARG_OFFSET(volume.limit)    , DBUS_TYPE_INT32  },
+    {  NULL    ,            0                , DBUS_TYPE_INVALID}
+};
+
+static struct argdsc cork_args[] = {
+    {"group"   , ARG_OFFSET(cork.group)      , DBUS_TYPE_STRING },
+    {"cork"    , ARG_OFFSET(cork.cork)       , DBUS_TYPE_STRING },
+    {  NULL    ,            0                , DBUS_TYPE_INVALID}
+};
+
+static struct argdsc mute_args[] = {
+    {"device"  , ARG_OFFSET(mute.device)     , DBUS_TYPE_STRING },
+    {"mute"    , ARG_OFFSET(mute.mute)       , DBUS_TYPE_STRING },
+    {  NULL    ,            0                , DBUS_TYPE_INVALID}
+};
+
+static struct argdsc context_args[] = {
+    {"variable", ARG_OFFSET(context.variable), DBUS_TYPE_STRING },
+    {"value"   , ARG_OFFSET(context.value)   , DBUS_TYPE_STRING },
+    {  NULL    ,            0                , DBUS_TYPE_INVALID}
+};
+
+/*
+ * When decisions are merged only the last command of an action
+ * survives for every target, ie. route class, group or device.
+ * Context variables have no merge key; all their changes are applied.
+ */
+static struct actdsc actions[] = {
+    { "com.nokia.policy.audio_route" , route_args  ,
+      audio_route_check , audio_route_apply , ARG_OFFSET(route.type),
+      {0, 0, {NULL}, {0}} },
+    { "com.nokia.policy.volume_limit", volume_args ,
+      volume_limit_check, volume_limit_apply, ARG_OFFSET(volume.group),
+      {0, 0, {NULL}, {0}} },
+    { "com.nokia.policy.audio_cork"  , cork_args   ,
+      audio_cork_check  , audio_cork_apply  , ARG_OFFSET(cork.group),
+      {0, 0, {NULL}, {0}} },
+    { "com.nokia.policy.audio_mute"  , mute_args   ,
+      audio_mute_check  , audio_mute_apply  , ARG_OFFSET(mute.device),
+      {0, 0, {NULL}, {0}} },
+    { "com.nokia.policy.context"     , context_args,
+      context_check     , context_apply     , -1,
+      {0, 0, {NULL}, {0}} },
+    {               NULL             , NULL        ,
+      NULL              , NULL              , 0,
+      {0, 0, {NULL}, {0}} }
+};
+
+#undef ARG_OFFSET
+
+static struct phash action_hash;     /* action names */
+
 
 
 struct pa_policy_dbusif *pa_policy_dbusif_init(struct userdata *u,
@@ -118,6 +267,8 @@ struct pa_policy_dbusif *pa_policy_dbusif_init(struct userdata *u,
     
     dbusif = pa_xnew0(struct pa_policy_dbusif, 1);
 
+    build_dispatch_hashes();
+
     dbus_error_init(&error);
     dbusif->conn = pa_dbus_bus_get(m->core, DBUS_BUS_SYSTEM, &error);
 
@@ -216,9 +367,21 @@ static void pa_policy_free_dbusif(struct pa_policy_dbusif *dbusif,
                                   struct userdata *u)
 {
     DBusConnection          *dbusconn;
+    int                      i;
 
     if (dbusif) {
 
+        if (dbusif->defer != NULL)
+            dbusif->mainloop->defer_free(dbusif->defer);
+
+        /* the decisions still in the queue are never applied */
+        if (u && u->dbusif == dbusif && dbusif->conn) {
+            for (i = 0;  i < dbusif->queue.ndec;  i++)
+                signal_status(u, dbusif->queue.decs[i].txid, FALSE);
+        }
+
+        free_decisions(&dbusif->queue);
+
         if (dbusif->conn) {
             dbusconn = pa_dbus_connection_get(dbusif->conn);
 
@@ -252,6 +415,30 @@ void pa_policy_dbusif_done(struct userdata *u)
     }
 }
 
+void pa_policy_dbusif_coalesce(struct userdata *u, const char *coalesce)
+{
+    struct pa_policy_dbusif *dbusif;
+
+    pa_assert(u);
+    pa_assert_se((dbusif = u->dbusif));
+
+    if (coalesce != NULL) {
+        if (!strcmp(coalesce, "on"))
+            dbusif->coalesce = TRUE;
+        else if (strcmp(coalesce, "off"))
+            pa_log("invalid value '%s' for action coalescing", coalesce);
+    }
+
+    if (dbusif->coalesce && dbusif->defer == NULL) {
+        dbusif->mainloop = u->core->mainloop;
+        dbusif->defer    = dbusif->mainloop->defer_new(dbusif->mainloop,
+                                                       apply_queued, u);
+        dbusif->mainloop->defer_enable(dbusif->defer, FALSE);
+    }
+
+    pa_log_info("action coalescing is %s", dbusif->coalesce ? "on" : "off");
+}
+
 void pa_policy_dbusif_send_device_state(struct userdata *u, char *state,
                                         char **types, int ntype)
 {
@@ -344,6 +531,28 @@ static DBusHandlerResult filter(DBusConnection *conn, DBusMessage *msg,
                                 void *arg)
 {
     struct userdata  *u = arg;
+    struct pa_policy_dbusif *dbusif = u->dbusif;
+
+    if (dbusif != NULL && dbus_message_has_path(msg, dbusif->mypath) &&
+        dbus_message_is_method_call(msg, dbusif->ifnam, POLICY_GROUP_STATS))
+    {
+        handle_stats_request(u, conn, msg);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    if (dbusif != NULL && dbus_message_has_path(msg, dbusif->mypath) &&
+        dbus_message_is_method_call(msg, dbusif->ifnam,POLICY_CONTEXT_HISTORY))
+    {
+        handle_history_request(u, conn, msg);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    if (dbusif != NULL && dbus_message_has_path(msg, dbusif->mypath) &&
+        dbus_message_is_method_call(msg, dbusif->ifnam, POLICY_CONTEXT_DUMP))
+    {
+        handle_dump_request(u, conn, msg);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
 
     if (dbus_message_is_signal(msg, ADMIN_DBUS_INTERFACE,
                                ADMIN_NAME_OWNER_CHANGED))
@@ -451,315 +660,775 @@ static void handle_info_message(struct userdata *u, DBusMessage *msg)
 
 static void handle_action_message(struct userdata *u, DBusMessage *msg)
 {
-    static struct actdsc actions[] = {
-        { "com.nokia.policy.audio_route" , audio_route_parser  },
-        { "com.nokia.policy.volume_limit", volume_limit_parser },
-        { "com.nokia.policy.audio_cork"  , audio_cork_parser   },
-        { "com.nokia.policy.audio_mute"  , audio_mute_parser   },
-        { "com.nokia.policy.context"     , context_parser      },
-        {               NULL             , NULL                }
-    };
-
-    struct actdsc   *act;
-    dbus_uint32_t    txid;
-    char            *actname;
-    DBusMessageIter  msgit;
-    DBusMessageIter  arrit;
-    DBusMessageIter  entit;
-    DBusMessageIter  actit;
-    int              success = TRUE;
+    struct pa_policy_dbusif *dbusif = u->dbusif;
+    struct actbuf            buf;
+    dbus_uint32_t            txid;
 
     pa_log_debug("got policy actions");
 
-    dbus_message_iter_init(msg, &msgit);
-
-    if (dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_UINT32)
+    if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &txid,
+                               DBUS_TYPE_INVALID))
         return;
 
-    dbus_message_iter_get_basic(&msgit, (void *)&txid);
-
     pa_log_debug("got actions (txid:%d)", txid);
 
-    if (!dbus_message_iter_next(&msgit) ||
-        dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_ARRAY) {
-        success = FALSE;
-        goto send_signal;
+    if (dbusif->coalesce) {
+        queue_decision(&dbusif->queue, msg, txid);
+        dbusif->mainloop->defer_enable(dbusif->defer, TRUE);
     }
+    else {
+        memset(&buf, 0, sizeof(buf));
 
-    dbus_message_iter_recurse(&msgit, &arrit);
+        queue_decision(&buf, msg, txid);
+        apply_decisions(u, &buf, FALSE);
+    }
+}
 
-    do {
-        if (dbus_message_iter_get_arg_type(&arrit) != DBUS_TYPE_DICT_ENTRY) {
-            success = FALSE;
-            continue;
-        }
+/*
+ * The signature has been checked already, so only the variant
+ * values need type checking here.
+ */
+static int decode_actions(DBusMessage *msg, struct actbuf *buf)
+{
+    DBusMessageIter  msgit;
+    DBusMessageIter  arrit;
+    DBusMessageIter  entit;
+    DBusMessageIter  actit;
+    struct actdsc   *act;
+    char            *actname;
+    int              idx;
+
+    dbus_message_iter_init(msg, &msgit);
+    dbus_message_iter_next(&msgit);              /* skip txid */
+    dbus_message_iter_recurse(&msgit, &arrit);
 
+    while (dbus_message_iter_get_arg_type(&arrit) == DBUS_TYPE_DICT_ENTRY) {
         dbus_message_iter_recurse(&arrit, &entit);
+        dbus_message_iter_get_basic(&entit, (void *)&actname);
+        dbus_message_iter_next(&entit);
+        dbus_message_iter_recurse(&entit, &actit);
 
-        do {
-            if (dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_STRING) {
-                success = FALSE;
-                continue;
-            }
-            
-            dbus_message_iter_get_basic(&entit, (void *)&actname);
-            
-            if (!dbus_message_iter_next(&entit) ||
-                dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_ARRAY) {
-                success = FALSE;
-                continue;
-            }
-            
-            dbus_message_iter_recurse(&entit, &actit);
-            
-            if (dbus_message_iter_get_arg_type(&actit) != DBUS_TYPE_ARRAY) {
-                success = FALSE;
-                continue;
-            }
-            
-            for (act = actions;   act->name != NULL;   act++) {
-                if (!strcmp(actname, act->name))
-                    break;
-            }
-                                    
-            if (act->parser != NULL)
-                success &= act->parser(u, &actit);
+        if ((idx = phash_lookup(&action_hash, actname)) < 0)
+            pa_log_debug("ignoring unknown action '%s'", actname);
+        else {
+            act = actions + idx;
 
-        } while (dbus_message_iter_next(&entit));
+            while (dbus_message_iter_get_arg_type(&actit) == DBUS_TYPE_ARRAY){
+                if (!decode_command(&actit, new_command(buf, act)))
+                    return FALSE;
+
+                dbus_message_iter_next(&actit);
+            }
+        }
 
-    } while (dbus_message_iter_next(&arrit));
+        dbus_message_iter_next(&arrit);
+    }
 
- send_signal:
-    signal_status(u, txid, success);
+    return TRUE;
 }
 
-static int action_parser(DBusMessageIter *actit, struct argdsc *descs,
-                         void *args, int len)
+static int decode_command(DBusMessageIter *actit, struct actcmd *cmd)
 {
+    struct actdsc   *act = cmd->action;
     DBusMessageIter  cmdit;
     DBusMessageIter  argit;
     DBusMessageIter  valit;
     struct argdsc   *desc;
     char            *argname;
-    void            *argval;
-    
+    int              idx;
+
     dbus_message_iter_recurse(actit, &cmdit);
 
-    memset(args, 0, len);
+    while (dbus_message_iter_get_arg_type(&cmdit) == DBUS_TYPE_STRUCT) {
+        dbus_message_iter_recurse(&cmdit, &argit);
+        dbus_message_iter_get_basic(&argit, (void *)&argname);
+        dbus_message_iter_next(&argit);
+        dbus_message_iter_recurse(&argit, &valit);
 
-    do {
-        if (dbus_message_iter_get_arg_type(&cmdit) != DBUS_TYPE_STRUCT)
-            return FALSE;
+        if ((idx = phash_lookup(&act->hash, argname)) >= 0) {
+            desc = act->args + idx;
 
-        dbus_message_iter_recurse(&cmdit, &argit);
+            if (dbus_message_iter_get_arg_type(&valit) != desc->type) {
+                pa_log("%s: invalid type for argument '%s' of %s", __FILE__,
+                       argname, act->name);
+                return FALSE;
+            }
 
-        if (dbus_message_iter_get_arg_type(&argit) != DBUS_TYPE_STRING)
-            return FALSE;
+            dbus_message_iter_get_basic(&valit, (char *)&cmd->args+desc->offs);
+        }
 
-        dbus_message_iter_get_basic(&argit, (void *)&argname);
-            
-        if (!dbus_message_iter_next(&argit))
-            return FALSE;
+        dbus_message_iter_next(&cmdit);
+    }
 
-        if (dbus_message_iter_get_arg_type(&argit) != DBUS_TYPE_VARIANT)
-            return FALSE;
+    return act->check(&cmd->args);
+}
 
-        dbus_message_iter_recurse(&argit, &valit);
-                    
-        for (desc = descs;  desc->name != NULL;  desc++) {
-            if (!strcmp(argname, desc->name)) {
-                if (desc->offs + (int)sizeof(char *) > len) {
-                    pa_log("%s: %s() desc offset %d  is out of range %d",
-                           __FILE__, __FUNCTION__, desc->offs, len);
-                    return FALSE;
-                }
-                else {
-                    if (dbus_message_iter_get_arg_type(&valit) != desc->type)
-                        return FALSE;
+static struct actcmd *new_command(struct actbuf *buf, struct actdsc *act)
+{
+    struct actcmd *cmd;
 
-                    argval = (char *)args + desc->offs;
+    if (buf->ncmd >= buf->size) {
+        buf->size = buf->size ? buf->size * 2 : 8;
+        buf->cmds = pa_xrealloc(buf->cmds, sizeof(*cmd) * buf->size);
+    }
 
-                    dbus_message_iter_get_basic(&valit, argval);
-                }
-                break;
-            }
-        }
+    cmd = buf->cmds + buf->ncmd++;
 
-    } while (dbus_message_iter_next(&cmdit));
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->action = act;
+    cmd->owner  = buf->ndec - 1;
 
-    return TRUE;
+    return cmd;
 }
 
-static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
+/*
+ * Decode a decision into the buffer. The whole decision is decoded before
+ * anything is applied; a malformed message is rejected without side effects.
+ */
+static void queue_decision(struct actbuf *buf, DBusMessage *msg,
+                           uint32_t txid)
 {
-    static struct argdsc descs[] = {
-        {"type"  , STRUCT_OFFSET(struct argrt, type)  , DBUS_TYPE_STRING },
-        {"device", STRUCT_OFFSET(struct argrt, device), DBUS_TYPE_STRING },
-        {"mode"  , STRUCT_OFFSET(struct argrt, mode),   DBUS_TYPE_STRING },
-        {"hwid"  , STRUCT_OFFSET(struct argrt, hwid),   DBUS_TYPE_STRING },
-        {  NULL  ,            0                       , DBUS_TYPE_INVALID}
-    };
+    struct actdec *dec;
+    int            ncmd;
 
-    struct argrt args;
-    enum pa_policy_route_class class;
-    char *target;
-    char *mode;
-    char *hwid;
+    if (buf->ndec >= buf->decsize) {
+        buf->decsize = buf->decsize ? buf->decsize * 2 : 4;
+        buf->decs = pa_xrealloc(buf->decs, sizeof(*dec) * buf->decsize);
+    }
+
+    dec = buf->decs + buf->ndec++;
+
+    dec->msg     = dbus_message_ref(msg);
+    dec->txid    = txid;
+    dec->success = TRUE;
+
+    ncmd = buf->ncmd;
+
+    if (!dbus_message_has_signature(msg, POLICY_ACTIONS_SIGNATURE)) {
+        pa_log("%s: invalid %s signature '%s' (txid:%d)", __FILE__,
+               POLICY_ACTIONS, dbus_message_get_signature(msg), txid);
+        dec->success = FALSE;
+    }
+    else if (!decode_actions(msg, buf)) {
+        pa_log("%s: malformed %s message (txid:%d)", __FILE__,
+               POLICY_ACTIONS, txid);
+        dec->success = FALSE;
+    }
 
-    do {
-        if (!action_parser(actit, descs, &args, sizeof(args)))
-            return FALSE;
+    if (!dec->success)
+        buf->ncmd = ncmd;       /* drop what was decoded of it */
+}
 
-        if (args.type == NULL || args.device == NULL)
-            return FALSE;
+/*
+ * Keep only the last command for every target of an action. The rest
+ * would be overridden right away by the later decisions anyway.
+ */
+static void merge_commands(struct actbuf *buf)
+{
+    struct actcmd *cmd;
+    struct actcmd *prev;
+    const char    *target;
+    int            i, j;
+
+    for (i = buf->ncmd - 1;  i > 0;  i--) {
+        cmd = buf->cmds + i;
+
+        /*
+         * the rules of a context variable fire on each change, so the
+         * intermediate values are not superseded by the last one
+         */
+        if (cmd->skip || cmd->action->target < 0)
+            continue;
 
-        if (!strcmp(args.type, "sink"))
-            class = pa_policy_route_to_sink;
-        else if (!strcmp(args.type, "source"))
-            class = pa_policy_route_to_source;
-        else
-            return FALSE;
+        target = *(char **)((char *)&cmd->args + cmd->action->target);
 
-        target = args.device;
-        mode   = (args.mode && strcmp(args.mode, "na")) ? args.mode : ""; 
-        hwid   = (args.hwid && strcmp(args.hwid, "na")) ? args.hwid : "";
+        for (j = i - 1;  j >= 0;  j--) {
+            prev = buf->cmds + j;
 
-        pa_log_debug("route %s to %s (%s|%s)", args.type, target, mode, hwid);
+            if (!prev->skip && prev->action == cmd->action &&
+                !strcmp(target, *(char **)((char *)&prev->args +
+                                           prev->action->target)))
+            {
+                pa_log_debug("%s for '%s' (txid:%d) is superseded",
+                             prev->action->name, target,
+                             buf->decs[prev->owner].txid);
+                prev->skip = TRUE;
+            }
+        }
+    }
+}
 
-        if (pa_card_ext_set_profile(u, target) < 0 ||
-            pa_policy_group_move_to(u, NULL, class, target, mode, hwid) < 0)
+static void apply_decisions(struct userdata *u, struct actbuf *buf,
+                            int merge)
+{
+    struct actcmd *cmd;
+    struct actdec *dec;
+    int            ctxown;
+    int            i;
+
+    if (merge)
+        merge_commands(buf);
+
+    /*
+     * coalesced context variables are flushed before any other action
+     * and at the end of their decision; this keeps the order of the
+     * actions and puts the outcome of the rules into the status
+     */
+    for (ctxown = -1, i = 0;  i < buf->ncmd;  i++) {
+        cmd = buf->cmds + i;
+
+        if (ctxown >= 0 && (cmd->action->apply != context_apply ||
+                            cmd->owner         != ctxown))
         {
-            pa_log("%s: can't route to %s %s", __FILE__, args.type, target);
-            return FALSE;
+            if (!pa_policy_context_flush(u))
+                buf->decs[ctxown].success = FALSE;
+            ctxown = -1;
         }
 
-    } while (dbus_message_iter_next(actit));
+        if (cmd->skip)
+            continue;
+
+        if (!cmd->action->apply(u, &cmd->args))
+            buf->decs[cmd->owner].success = FALSE;
+
+        if (cmd->action->apply == context_apply)
+            ctxown = cmd->owner;
+    }
+
+    if (ctxown >= 0 && !pa_policy_context_flush(u))
+        buf->decs[ctxown].success = FALSE;
+
+    /* every decision gets its status, merged or not */
+    for (i = 0;  i < buf->ndec;  i++) {
+        dec = buf->decs + i;
+        signal_status(u, dec->txid, dec->success);
+    }
+
+    free_decisions(buf);
+}
+
+static void apply_queued(pa_mainloop_api *m, pa_defer_event *e,
+                         void *userdata)
+{
+    struct userdata         *u = userdata;
+    struct pa_policy_dbusif *dbusif = u->dbusif;
+    DBusConnection          *conn;
+
+    conn = pa_dbus_connection_get(dbusif->conn);
+
+    /*
+     * wait until the pending messages are dispatched;
+     * there might be more decisions among them
+     */
+    if (dbus_connection_get_dispatch_status(conn) == DBUS_DISPATCH_DATA_REMAINS)
+        return;
+
+    m->defer_enable(e, FALSE);
+
+    pa_log_debug("applying %d queued decision(s)", dbusif->queue.ndec);
+
+    apply_decisions(u, &dbusif->queue, TRUE);
+}
+
+static void free_decisions(struct actbuf *buf)
+{
+    int i;
+
+    for (i = 0;  i < buf->ndec;  i++)
+        dbus_message_unref(buf->decs[i].msg);
+
+    pa_xfree(buf->cmds);
+    pa_xfree(buf->decs);
+
+    memset(buf, 0, sizeof(*buf));
+}
+
+static int audio_route_check(union actargs *a)
+{
+    struct argrt *args = &a->route;
+
+    if (args->type == NULL || args->device == NULL)
+        return FALSE;
+
+    if (!strcmp(args->type, "sink"))
+        args->class = pa_policy_route_to_sink;
+    else if (!strcmp(args->type, "source"))
+        args->class = pa_policy_route_to_source;
+    else
+        return FALSE;
+
+    if (!args->mode || !strcmp(args->mode, "na"))
+        args->mode = "";
+
+    if (!args->hwid || !strcmp(args->hwid, "na"))
+        args->hwid = "";
 
     return TRUE;
 }
 
-static int volume_limit_parser(struct userdata *u, DBusMessageIter *actit)
+static int audio_route_apply(struct userdata *u, union actargs *a)
 {
-    static struct argdsc descs[] = {
-        {"group", STRUCT_OFFSET(struct argvol, group), DBUS_TYPE_STRING },
-        {"limit", STRUCT_OFFSET(struct argvol, limit), DBUS_TYPE_INT32  },
-        {  NULL ,            0                       , DBUS_TYPE_INVALID}
-    };
+    struct argrt *args = &a->route;
 
-    struct argvol  args;
+    pa_log_debug("route %s to %s (%s|%s)", args->type, args->device,
+                 args->mode, args->hwid);
 
-    do {
-        if (!action_parser(actit, descs, &args, sizeof(args)))
-            return FALSE;
+    if (pa_card_ext_set_profile(u, args->device) < 0 ||
+        pa_policy_group_move_to(u, NULL, args->class, args->device,
+                                args->mode, args->hwid) < 0)
+    {
+        pa_log("%s: can't route to %s %s", __FILE__, args->type,
+               args->device);
+        return FALSE;
+    }
 
-        if (args.group == NULL || args.limit < 0 || args.limit > 100)
-            return FALSE;
+    return TRUE;
+}
 
-        pa_log_debug("volume limit (%s|%d)", args.group, args.limit); 
+static int volume_limit_check(union actargs *a)
+{
+    struct argvol *args = &a->volume;
 
-        pa_policy_group_volume_limit(u, args.group, (uint32_t)args.limit);
+    if (args->group == NULL || args->limit < 0 || args->limit > 100)
+        return FALSE;
 
-    } while (dbus_message_iter_next(actit));
+    return TRUE;
+}
+
+static int volume_limit_apply(struct userdata *u, union actargs *a)
+{
+    struct argvol *args = &a->volume;
+
+    pa_log_debug("volume limit (%s|%d)", args->group, args->limit);
+
+    pa_policy_group_volume_limit(u, args->group, (uint32_t)args->limit);
 
     return TRUE;
 }
 
-static int audio_cork_parser(struct userdata *u, DBusMessageIter *actit)
+static int audio_cork_check(union actargs *a)
 {
-    static struct argdsc descs[] = {
-        {"group", STRUCT_OFFSET(struct argcork, group), DBUS_TYPE_STRING },
-        {"cork" , STRUCT_OFFSET(struct argcork, cork) , DBUS_TYPE_STRING },
-        { NULL  ,            0                        , DBUS_TYPE_INVALID}
-    };
-    
-    struct argcork  args;
-    char           *grp;
-    int             val;
-    
-    do {
-        if (!action_parser(actit, descs, &args, sizeof(args)))
-            return FALSE;
+    struct argcork *args = &a->cork;
 
-        if (args.group == NULL || args.cork == NULL)
-            return FALSE;
+    if (args->group == NULL || args->cork == NULL)
+        return FALSE;
 
-        grp = args.group;
+    if (!strcmp(args->cork, "corked"))
+        args->val = 1;
+    else if (!strcmp(args->cork, "uncorked"))
+        args->val = 0;
+    else
+        return FALSE;
 
-        if (!strcmp(args.cork, "corked"))
-            val = 1;
-        else if (!strcmp(args.cork, "uncorked"))
-            val = 0;
-        else
-            return FALSE;
-        
-        pa_log_debug("cork stream (%s|%d)", grp, val);
-        pa_policy_group_cork(u, grp, val);
+    return TRUE;
+}
+
+static int audio_cork_apply(struct userdata *u, union actargs *a)
+{
+    struct argcork *args = &a->cork;
+
+    pa_log_debug("cork stream (%s|%d)", args->group, args->val);
+    pa_policy_group_cork(u, args->group, args->val);
 
-    } while (dbus_message_iter_next(actit));
-    
     return TRUE;
 }
 
-static int audio_mute_parser(struct userdata *u, DBusMessageIter *actit)
+static int audio_mute_check(union actargs *a)
 {
-    static struct argdsc descs[] = {
-        {"device", STRUCT_OFFSET(struct argmute, device), DBUS_TYPE_STRING },
-        {"mute"  , STRUCT_OFFSET(struct argmute, mute)  , DBUS_TYPE_STRING },
-        { NULL   ,            0                         , DBUS_TYPE_INVALID}
-    };
-    
-    struct argmute  args;
-    char           *device;
-    int             val;
-    
-    do {
-        if (!action_parser(actit, descs, &args, sizeof(args)))
-            return FALSE;
+    struct argmute *args = &a->mute;
 
-        if (args.device == NULL || args.mute == NULL)
-            return FALSE;
+    if (args->device == NULL || args->mute == NULL)
+        return FALSE;
 
-        device = args.device;
+    if (!strcmp(args->mute, "muted"))
+        args->val = 1;
+    else if (!strcmp(args->mute, "unmuted"))
+        args->val = 0;
+    else
+        return FALSE;
 
-        if (!strcmp(args.mute, "muted"))
-            val = 1;
-        else if (!strcmp(args.mute, "unmuted"))
-            val = 0;
-        else
-            return FALSE;
-        
-        pa_log_debug("mute device (%s|%d)", device, val);
-        pa_source_ext_set_mute(u, device, val);
+    return TRUE;
+}
+
+static int audio_mute_apply(struct userdata *u, union actargs *a)
+{
+    struct argmute *args = &a->mute;
+
+    pa_log_debug("mute device (%s|%d)", args->device, args->val);
+    pa_source_ext_set_mute(u, args->device, args->val);
 
-    } while (dbus_message_iter_next(actit));
-    
     return TRUE;
 }
 
-static int context_parser(struct userdata *u, DBusMessageIter *actit)
+static int context_check(union actargs *a)
+{
+    struct argctx *args = &a->context;
+
+    return args->variable != NULL && args->value != NULL;
+}
+
+static int context_apply(struct userdata *u, union actargs *a)
 {
-    static struct argdsc descs[] = {
-        {"variable", STRUCT_OFFSET(struct argctx,variable), DBUS_TYPE_STRING },
-        {"value"   , STRUCT_OFFSET(struct argctx,value)   , DBUS_TYPE_STRING },
-        {  NULL    ,            0                         , DBUS_TYPE_INVALID}
+    struct argctx *args = &a->context;
+
+    pa_log_debug("context (%s|%s)", args->variable, args->value);
+
+    return pa_policy_context_variable_changed(u, args->variable, args->value);
+}
+
+/*
+ * Build collision free hashes of the action and argument names, so that
+ * decoding a name costs one hash and one string compare.
+ */
+static void build_dispatch_hashes(void)
+{
+    static int      built;
+
+    struct actdsc  *act;
+    const char     *names[PHASH_DIM];
+    int             n;
+
+    if (built)
+        return;
+
+    for (n = 0;  n < PHASH_DIM && actions[n].name != NULL;  n++)
+        names[n] = actions[n].name;
+
+    /* the tables are static; failing here is a bug, not a runtime error */
+    pa_assert_se(phash_build(&action_hash, names, n));
+
+    for (act = actions;  act->name != NULL;  act++) {
+        for (n = 0;  n < PHASH_DIM && act->args[n].name != NULL;  n++)
+            names[n] = act->args[n].name;
+
+        pa_assert_se(phash_build(&act->hash, names, n));
+    }
+
+    built = TRUE;
+}
+
+/*
+ * Try the hash sizes from the smallest power of two upwards and a range
+ * of seeds for each until every name gets a slot of its own.
+ */
+static int phash_build(struct phash *ph, const char **names, int n)
+{
+    uint32_t dim;
+    uint32_t seed;
+    uint32_t slot;
+    int      i;
+
+    for (dim = 1;  dim < (uint32_t)n;  dim <<= 1)
+        ;
+
+    for (;  dim <= PHASH_DIM;  dim <<= 1) {
+        for (seed = 1;  seed <= PHASH_SEEDS;  seed++) {
+            memset(ph, 0, sizeof(*ph));
+
+            ph->seed = seed;
+            ph->mask = dim - 1;
+
+            for (i = 0;  i < n;  i++) {
+                slot = phash_value(seed, names[i]) & ph->mask;
+
+                if (ph->keys[slot] != NULL)
+                    break;
+
+                ph->keys[slot]  = names[i];
+                ph->index[slot] = i;
+            }
+
+            if (i == n)
+                return TRUE;
+        }
+    }
+
+    memset(ph, 0, sizeof(*ph));
+
+    return FALSE;
+}
+
+static int phash_lookup(struct phash *ph, const char *name)
+{
+    const char *key;
+    uint32_t    slot;
+
+    slot = phash_value(ph->seed, name) & ph->mask;
+    key  = ph->keys[slot];
+
+    return (key != NULL && !strcmp(key, name)) ? ph->index[slot] : -1;
+}
+
+/*
+ * The seed is mixed into the shared string hash so that each seed
+ * spreads the names differently over the low bits used as the slot.
+ */
+static uint32_t phash_value(uint32_t seed, const char *s)
+{
+    uint32_t hash = pa_policy_hash_string(s) ^ (seed * 0x9e3779b9U);
+
+    hash ^= hash >> 15;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+static void handle_stats_request(struct userdata *u, DBusConnection *conn,
+                                 DBusMessage *msg)
+{
+    struct pa_policy_group *group;
+    DBusMessage            *reply;
+    DBusMessageIter         mit;
+    DBusMessageIter         ait;
+    DBusMessageIter         eit;
+    void                   *cursor = NULL;
+
+    reply = dbus_message_new_method_return(msg);
+
+    if (reply == NULL) {
+        pa_log("%s: failed to make new %s reply", __FILE__,
+               POLICY_GROUP_STATS);
+        return;
+    }
+
+    dbus_message_iter_init_append(reply, &mit);
+
+    if (!dbus_message_iter_open_container(&mit, DBUS_TYPE_ARRAY,
+                                          "{sa{st}}", &ait))
+        goto fail;
+
+    while ((group = pa_policy_group_scan(u->groups, &cursor)) != NULL) {
+        if (!dbus_message_iter_open_container(&ait, DBUS_TYPE_DICT_ENTRY,
+                                              NULL, &eit)                    ||
+            !dbus_message_iter_append_basic(&eit, DBUS_TYPE_STRING,
+                                            &group->name)                    ||
+            append_group_stats(&eit, group) < 0                              ||
+            !dbus_message_iter_close_container(&ait, &eit)                     )
+        {
+            if (cursor != NULL)
+                pa_xfree(cursor);
+            goto fail;
+        }
+    }
+
+    if (!dbus_message_iter_close_container(&mit, &ait))
+        goto fail;
+
+    if (!dbus_connection_send(conn, reply, NULL))
+        pa_log("%s: Can't send %s reply: out of memory", __FILE__,
+               POLICY_GROUP_STATS);
+
+    dbus_message_unref(reply);
+
+    return;
+
+ fail:
+    pa_log("%s: failed to build %s reply", __FILE__, POLICY_GROUP_STATS);
+
+    dbus_message_unref(reply);
+
+    reply = dbus_message_new_error(msg, DBUS_ERROR_FAILED,
+                                   "failed to build group statistics");
+
+    if (reply != NULL) {
+        dbus_connection_send(conn, reply, NULL);
+        dbus_message_unref(reply);
+    }
+}
+
+static int append_group_stats(DBusMessageIter *it,struct pa_policy_group *grp)
+{
+    struct pa_policy_group_stats *st = &grp->stats;
+    DBusMessageIter               dit;
+    DBusMessageIter               eit;
+    const char                   *name;
+    uint64_t                      value;
+    int                           i;
+
+    struct {
+        const char *name;
+        uint64_t    value;
+    } counters[] = {
+        { "sink_inputs"       , grp->sinpcnt                      },
+        { "source_outputs"    , grp->soutcnt                      },
+        { "inserts"           , st->ninsert                       },
+        { "removals"          , st->nremove                       },
+        { "moves"             , st->nmove                         },
+        { "failed_moves"      , st->nmvfail                       },
+        { "corks"             , st->ncork                         },
+        { "uncorks"           , st->nuncork                       },
+        { "volume_limits"     , st->nvolset                       },
+        { "rejected"          , grp->nreject                      },
+        { "shed"              , grp->nshed                        },
+        { "active_usec"       , pa_policy_group_active_time(grp)  },
+        { "move_calls"        , st->move.calls                    },
+        { "move_usec"         , st->move.total                    },
+        { "move_max_usec"     , st->move.max                      },
+        { "cork_calls"        , st->cork.calls                    },
+        { "cork_usec"         , st->cork.total                    },
+        { "cork_max_usec"     , st->cork.max                      },
+        { "volset_calls"      , st->volset.calls                  },
+        { "volset_usec"       , st->volset.total                  },
+        { "volset_max_usec"   , st->volset.max                    },
     };
-    
-    struct argctx   args;
-    
-    do {
-        if (!action_parser(actit, descs, &args, sizeof(args)))
-            return FALSE;
 
-        if (args.variable == NULL || args.value == NULL)
-            return FALSE;
+    if (!dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, "{st}", &dit))
+        return -1;
 
-        pa_log_debug("context (%s|%s)", args.variable, args.value);
+    for (i = 0;  i < (int)(sizeof(counters)/sizeof(counters[0]));  i++) {
+        name  = counters[i].name;
+        value = counters[i].value;
 
-        pa_policy_context_variable_changed(u, args.variable, args.value);
+        if (!dbus_message_iter_open_container(&dit, DBUS_TYPE_DICT_ENTRY,
+                                              NULL, &eit)                ||
+            !dbus_message_iter_append_basic(&eit, DBUS_TYPE_STRING, &name)  ||
+            !dbus_message_iter_append_basic(&eit, DBUS_TYPE_UINT64, &value) ||
+            !dbus_message_iter_close_container(&dit, &eit)                    )
+            return -1;
+    }
 
-    } while (dbus_message_iter_next(actit));
-    
-    return TRUE;
+    if (!dbus_message_iter_close_container(it, &dit))
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Reply with the context change history, oldest first, as
+ * a(tsssuut) (stamp, variable, old value, new value, rules, actions, usec)
+ * followed by the cumulative per-variable a{s(utt)} (changes, usec, max).
+ */
+static void handle_history_request(struct userdata *u, DBusConnection *conn,
+                                   DBusMessage *msg)
+{
+    DBusMessage     *reply;
+    DBusMessageIter  mit;
+
+    reply = dbus_message_new_method_return(msg);
+
+    if (reply == NULL) {
+        pa_log("%s: failed to make new %s reply", __FILE__,
+               POLICY_CONTEXT_HISTORY);
+        return;
+    }
+
+    dbus_message_iter_init_append(reply, &mit);
+
+    if (append_context_history(&mit, u->context) < 0 ||
+        append_variable_times(&mit, u->context)  < 0   )
+    {
+        pa_log("%s: failed to build %s reply", __FILE__,
+               POLICY_CONTEXT_HISTORY);
+
+        dbus_message_unref(reply);
+
+        reply = dbus_message_new_error(msg, DBUS_ERROR_FAILED,
+                                       "failed to build context history");
+        if (reply == NULL)
+            return;
+    }
+
+    if (!dbus_connection_send(conn, reply, NULL))
+        pa_log("%s: Can't send %s reply: out of memory", __FILE__,
+               POLICY_CONTEXT_HISTORY);
+
+    dbus_message_unref(reply);
+}
+
+static void handle_dump_request(struct userdata *u, DBusConnection *conn,
+                                DBusMessage *msg)
+{
+    DBusMessage *reply;
+
+    pa_policy_context_history_dump(u->context);
+
+    if ((reply = dbus_message_new_method_return(msg)) != NULL) {
+        if (!dbus_connection_send(conn, reply, NULL))
+            pa_log("%s: Can't send %s reply: out of memory", __FILE__,
+                   POLICY_CONTEXT_DUMP);
+
+        dbus_message_unref(reply);
+    }
+}
+
+static int append_context_history(DBusMessageIter          *it,
+                                  struct pa_policy_context *ctx)
+{
+    const struct pa_policy_context_history *hist;
+    DBusMessageIter                         ait;
+    DBusMessageIter                         sit;
+    const char                             *name;
+    const char                             *oldval;
+    const char                             *newval;
+    uint32_t                                i;
+
+    if (!dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, "(tsssuut)",
+                                          &ait))
+        return -1;
+
+    for (i = 0;  (hist = pa_policy_context_history_get(ctx, i)) != NULL;  i++){
+        name   = hist->name;
+        oldval = hist->oldval;
+        newval = hist->newval;
+
+        if (!dbus_message_iter_open_container(&ait, DBUS_TYPE_STRUCT,
+                                              NULL, &sit)                    ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT64,
+                                            &hist->stamp)                    ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_STRING, &name)   ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_STRING, &oldval) ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_STRING, &newval) ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT32,
+                                            &hist->nrule)                    ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT32,
+                                            &hist->naction)                  ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT64,
+                                            &hist->duration)                 ||
+            !dbus_message_iter_close_container(&ait, &sit)                     )
+            return -1;
+    }
+
+    if (!dbus_message_iter_close_container(it, &ait))
+        return -1;
+
+    return 0;
+}
+
+static int append_variable_times(DBusMessageIter          *it,
+                                 struct pa_policy_context *ctx)
+{
+    struct pa_policy_context_variable *var;
+    DBusMessageIter                    dit;
+    DBusMessageIter                    eit;
+    DBusMessageIter                    sit;
+
+    if (!dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, "{s(utt)}",
+                                          &dit))
+        return -1;
+
+    for (var = ctx->variables;  var != NULL;  var = var->next) {
+        if (!dbus_message_iter_open_container(&dit, DBUS_TYPE_DICT_ENTRY,
+                                              NULL, &eit)                    ||
+            !dbus_message_iter_append_basic(&eit, DBUS_TYPE_STRING,
+                                            &var->name)                      ||
+            !dbus_message_iter_open_container(&eit, DBUS_TYPE_STRUCT,
+                                              NULL, &sit)                    ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT32,
+                                            &var->nchange)                   ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT64,
+                                            &var->total)                     ||
+            !dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT64,
+                                            &var->max)                       ||
+            !dbus_message_iter_close_container(&eit, &sit)                   ||
+            !dbus_message_iter_close_container(&dit, &eit)                     )
+            return -1;
+    }
+
+    if (!dbus_message_iter_close_container(it, &dit))
+        return -1;
+
+    return 0;
 }
 
 static void registration_cb(DBusPendingCall *pend, void *data)
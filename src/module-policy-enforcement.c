@@ -39,6 +39,7 @@
 #include "card-ext.h"
 #include "module-ext.h"
 #include "dbusif.h"
+#include "state-file.h"
 
 #ifndef PA_DEFAULT_CONFIG_DIR
 #define PA_DEFAULT_CONFIG_DIR "/etc/pulse"
@@ -55,7 +56,11 @@ PA_MODULE_USAGE(
     "dbus_policyd_path=<policy daemon's path>"
     "dbus_policyd_name=<policy daemon's name>"
     "null_sink_name=<name of the null sink>"
-    "othermedia_preemption=<on|off>"
+    "othermedia_preemption=<on|off> "
+    "route_suspend=<on|off> "
+    "context_coalesce=<on|off> "
+    "action_coalesce=<on|off> "
+    "state_file=<file to persist the policy state across reloads>"
 );
 
 static const char* const valid_modargs[] = {
@@ -66,6 +71,10 @@ static const char* const valid_modargs[] = {
     "dbus_policyd_name",
     "null_sink_name",
     "othermedia_preemption",
+    "route_suspend",
+    "context_coalesce",
+    "action_coalesce",
+    "state_file",
     NULL
 };
 
@@ -80,6 +89,11 @@ int pa__init(pa_module *m) {
     const char      *pdnam;
     const char      *nsnam;
     const char      *preempt;
+    const char      *suspend;
+    const char      *coalesce;
+    const char      *actmerge;
+    const char      *statefile;
+    struct pa_policy_state *state;
     
     pa_assert(m);
     
@@ -95,6 +109,10 @@ int pa__init(pa_module *m) {
     pdnam   = pa_modargs_get_value(ma, "dbus_policyd_name", NULL);
     nsnam   = pa_modargs_get_value(ma, "null_sink_name", NULL);
     preempt = pa_modargs_get_value(ma, "othermedia_preemption", NULL);
+    suspend = pa_modargs_get_value(ma, "route_suspend", NULL);
+    coalesce = pa_modargs_get_value(ma, "context_coalesce", NULL);
+    actmerge = pa_modargs_get_value(ma, "action_coalesce", NULL);
+    statefile = pa_modargs_get_value(ma, "state_file", NULL);
 
     
     u = pa_xnew0(struct userdata, 1);
@@ -112,6 +130,7 @@ int pa__init(pa_module *m) {
     u->classify = pa_classify_new(u);
     u->context  = pa_policy_context_new(u);
     u->dbusif   = pa_policy_dbusif_init(u, ifnam, mypath, pdpath, pdnam);
+    u->statefile = statefile ? pa_xstrdup(statefile) : NULL;
 
     if (u->scl == NULL      || u->ssnk == NULL     || u->ssrc == NULL ||
         u->ssi == NULL      || u->sso == NULL      || u->scrd == NULL ||
@@ -121,11 +140,16 @@ int pa__init(pa_module *m) {
 
     pa_policy_groupset_update_default_sink(u, PA_IDXSET_INVALID);
     pa_policy_groupset_create_default_group(u, preempt);
+    pa_policy_groupset_route_suspend(u, suspend);
+    pa_policy_context_coalesce(u, coalesce);
+    pa_policy_dbusif_coalesce(u, actmerge);
 
     if (!pa_policy_parse_config_file(u, cfgfile))
         goto fail;
 
     m->userdata = u;
+
+    state = pa_policy_state_restore(u, u->statefile);
     
     pa_sink_ext_discover(u);
     pa_source_ext_discover(u);
@@ -135,6 +159,8 @@ int pa__init(pa_module *m) {
     pa_card_ext_discover(u);
     pa_module_ext_discover(u);
 
+    pa_policy_state_replay(u, state);
+
     pa_modargs_free(ma);
 
     
@@ -157,9 +183,14 @@ void pa__done(pa_module *m) {
     
     if (!(u = m->userdata))
         return;
+
+    pa_policy_state_save(u, u->statefile);
     
     pa_policy_dbusif_done(u);
 
+    if (u->groups != NULL)
+        pa_policy_groupset_remove_buses(u);
+
     pa_client_ext_subscription_free(u->scl);
     pa_sink_ext_subscription_free(u->ssnk);
     pa_source_ext_subscription_free(u->ssrc);
@@ -172,7 +203,8 @@ void pa__done(pa_module *m) {
     pa_classify_free(u->classify);
     pa_policy_context_free(u->context);
     pa_sink_ext_null_sink_free(u->nullsink);
-    
+
+    pa_xfree(u->statefile);
     pa_xfree(u);
 }
 
@@ -188,6 +220,24 @@ const char *pa_policy_file_path(const char *file, char *buf, size_t len)
     return buf;
 }
 
+/*
+ * string hash shared by the hash tables of the groups and the context;
+ * the callers mask the result to the size of their table
+ */
+uint32_t pa_policy_hash_string(const char *s)
+{
+    uint32_t hash = 0;
+    unsigned char c;
+
+    if (s) {
+        while ((c = *s++) != '\0') {
+            hash = 38501 * (hash + c);
+        }
+    }
+
+    return hash;
+}
+
 
 /*
  * Local Variables:
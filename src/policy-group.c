@@ -1,7 +1,12 @@
 #include <pulsecore/pulsecore-config.h>
 
 #include <pulsecore/namereg.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/module.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/rtclock.h>
 #include <pulse/volume.h>
+#include <pulse/xmalloc.h>
 
 #include "policy-group.h"
 #include "sink-ext.h"
@@ -11,6 +16,9 @@
 #include "classify.h"
 #include "dbusif.h"
 
+/* sink index as a key of suspidx; index 0 would be a NULL pointer */
+#define SUSPIDX_KEY(idx)   PA_UINT32_TO_PTR((idx) + 1)
+
 
 struct target {
     enum pa_policy_route_class  class;
@@ -35,19 +43,41 @@ static struct pa_source *defsource;
 static uint32_t          defsinkidx = PA_IDXSET_INVALID;
 static uint32_t          defsrcidx  = PA_IDXSET_INVALID;
 
-static int move_group(struct pa_policy_group *, struct target *);
-static int volset_group(struct pa_policy_group *, pa_volume_t);
+static int move_group(struct userdata *, struct pa_policy_group *,
+                      struct target *);
+static int volset_group(struct userdata *, struct pa_policy_group *,
+                        pa_volume_t);
 static int mute_group_by_route(struct pa_policy_group *, int,
                                struct pa_null_sink *);
+static int mute_group_in_place(struct userdata *, struct pa_policy_group *,
+                               int);
 static int cork_group(struct pa_policy_group *, int);
+static int move_sink_input(struct pa_policy_group *,
+                           struct pa_sink_input_list *, struct pa_sink *);
+static int flush_deferred_move(struct pa_policy_group *,
+                               struct pa_sink_input_list *);
+static int move_streams(struct pa_policy_group *, struct pa_sink *);
+static void shed_sink_input(struct userdata *, struct pa_policy_group *);
+static void unshed_sink_input(struct userdata *, struct pa_policy_group *);
+static void schedule_buses(struct pa_policy_groupset *);
+static void create_buses(pa_mainloop_api *, pa_defer_event *, void *);
+static struct pa_policy_group_bus *create_bus(struct userdata *,
+                                              struct pa_policy_group *);
+static void release_bus(struct userdata *, struct pa_policy_group *);
+static void set_bus_volume(struct pa_policy_group_bus *, pa_volume_t);
 
 static struct pa_policy_group *find_group_by_name(struct pa_policy_groupset *,
                                                   char *, uint32_t *);
 
+static void suspend_sink(struct userdata *, struct pa_sink *);
+static void resume_sink(struct userdata *, struct pa_sink *);
+
 static struct pa_sink   *find_sink_by_type(struct userdata *, char *);
 static struct pa_source *find_source_by_type(struct userdata *, char *);
 
-static uint32_t hash_value(char *);
+static int  latency_fits(pa_usec_t, pa_usec_t);
+static void update_active_time(struct pa_policy_group *);
+static void account_call(struct pa_policy_group_timer *, pa_usec_t);
 
 
 struct pa_policy_groupset *pa_policy_groupset_new(struct userdata *u)
@@ -57,6 +87,14 @@ struct pa_policy_groupset *pa_policy_groupset_new(struct userdata *u)
     pa_assert(u);
     
     gset = pa_xnew0(struct pa_policy_groupset, 1);
+    gset->suspidx = pa_idxset_new(pa_idxset_trivial_hash_func,
+                                  pa_idxset_trivial_compare_func);
+
+    /* buses are never loaded from within a hook; see create_buses() */
+    gset->mainloop = u->core->mainloop;
+    gset->busdefer = gset->mainloop->defer_new(gset->mainloop,
+                                               create_buses, u);
+    gset->mainloop->defer_enable(gset->busdefer, FALSE);
 
     return gset;
 }
@@ -65,11 +103,19 @@ void pa_policy_groupset_free(struct pa_policy_groupset *gset)
 {
     pa_assert(gset);
 
+    pa_idxset_free(gset->suspidx, NULL, NULL);
+
+    if (gset->busdefer != NULL)
+        gset->mainloop->defer_free(gset->busdefer);
+
     pa_xfree(gset);
 }
 
 void pa_policy_groupset_update_default_sink(struct userdata *u, uint32_t idx)
 {
+    static uint32_t route_flags = PA_POLICY_GROUP_FLAG_SET_SINK |
+                                  PA_POLICY_GROUP_FLAG_ROUTE_AUDIO;
+
     struct pa_policy_groupset *gset;
     struct pa_policy_group    *group;
     char                      *defsinkname;
@@ -123,10 +169,13 @@ void pa_policy_groupset_update_default_sink(struct userdata *u, uint32_t idx)
                         group->sink = defsink;
                         group->sinkidx = defsinkidx;
 
-                        /* TODO: we should move the streams to defsink */
+                        if (group->flags & route_flags)
+                            move_streams(group, defsink);
                     }
                 }
             }
+
+            schedule_buses(gset);
         }
     }
 }
@@ -134,6 +183,9 @@ void pa_policy_groupset_update_default_sink(struct userdata *u, uint32_t idx)
 
 void pa_policy_groupset_register_sink(struct userdata *u, struct pa_sink *sink)
 {
+    static uint32_t route_flags = PA_POLICY_GROUP_FLAG_SET_SINK |
+                                  PA_POLICY_GROUP_FLAG_ROUTE_AUDIO;
+
     struct pa_policy_groupset *gset;
     struct pa_policy_group    *group;
     char                      *sinkname;
@@ -159,15 +211,21 @@ void pa_policy_groupset_register_sink(struct userdata *u, struct pa_sink *sink)
                     group->sink    = sink;
                     group->sinkidx = sinkidx;
 
-                    /* TODO: we should move the streams to the sink */
+                    if (group->flags & route_flags)
+                        move_streams(group, sink);
                 }
             }
         }
+
+        schedule_buses(gset);
     }
 }
 
 void pa_policy_groupset_unregister_sink(struct userdata *u, uint32_t sinkidx)
 {
+    static uint32_t route_flags = PA_POLICY_GROUP_FLAG_SET_SINK |
+                                  PA_POLICY_GROUP_FLAG_ROUTE_AUDIO;
+
     struct pa_policy_groupset *gset;
     struct pa_policy_group    *group;
     int                        i;
@@ -176,6 +234,8 @@ void pa_policy_groupset_unregister_sink(struct userdata *u, uint32_t sinkidx)
     pa_assert_se((gset = u->groups));
 
     pa_log_debug("Unregister sink (idx=%d)", sinkidx);
+
+    pa_idxset_remove_by_data(gset->suspidx, SUSPIDX_KEY(sinkidx), NULL);
         
     for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
         for (group = gset->hash_tbl[i];    group;    group = group->next) {
@@ -186,7 +246,10 @@ void pa_policy_groupset_unregister_sink(struct userdata *u, uint32_t sinkidx)
                 group->sink    = NULL;
                 group->sinkidx = PA_IDXSET_INVALID;
 
-                /* TODO: we should move the streams to somewhere */
+                /* rescue the streams to the default sink, if we can */
+                if ((group->flags & route_flags) &&
+                    defsink != NULL && defsinkidx != sinkidx)
+                    move_streams(group, defsink);
             }
         }
     }
@@ -280,6 +343,161 @@ void pa_policy_groupset_create_default_group(struct userdata *u,
     gset->dflt = pa_policy_group_new(u, name, NULL, NULL, flags);
 }
 
+void pa_policy_groupset_route_suspend(struct userdata *u, const char *suspend)
+{
+    struct pa_policy_groupset *gset;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+
+    if (suspend != NULL) {
+        if (!strcmp(suspend, "on"))
+            gset->suspend = TRUE;
+        else if (strcmp(suspend, "off"))
+            pa_log("invalid value '%s' for route suspend", suspend);
+    }
+
+    pa_log_info("route suspend is %s", gset->suspend ? "on" : "off");
+}
+
+void pa_policy_groupset_resume_sink(struct userdata *u, struct pa_sink *sink)
+{
+    if (sink != NULL)
+        resume_sink(u, sink);
+}
+
+int pa_policy_groupset_is_bus(struct userdata *u, struct pa_module *m)
+{
+    struct pa_policy_groupset *gset;
+    struct pa_policy_group    *group;
+    int                        i;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+
+    /* everything that is created while loading a bus belongs to the bus */
+    if (gset->busload)
+        return TRUE;
+
+    if (m == NULL || m->index == PA_IDXSET_INVALID)
+        return FALSE;
+
+    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
+        for (group = gset->hash_tbl[i];    group;    group = group->next) {
+            if (group->bus != NULL && group->bus->modidx == m->index)
+                return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+int pa_policy_groupset_unregister_bus(struct userdata *u, struct pa_sink *sink)
+{
+    struct pa_policy_groupset  *gset;
+    struct pa_policy_group     *group;
+    struct pa_policy_group_bus *bus;
+    int                         i;
+
+    pa_assert(u);
+    pa_assert(sink);
+    pa_assert_se((gset = u->groups));
+
+    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
+        for (group = gset->hash_tbl[i];    group;    group = group->next) {
+            if ((bus = group->bus) != NULL && bus->sink == sink) {
+                pa_log_debug("bus of group '%s' is gone", group->name);
+
+                release_bus(u, group);
+
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * mute-by-route requests that came before the null sink, e.g. from the
+ * saved state of a previous instance, take effect now
+ */
+void pa_policy_groupset_register_null_sink(struct userdata *u)
+{
+    struct pa_policy_groupset *gset;
+    struct pa_policy_group    *group;
+    int                        i;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+    pa_assert(u->nullsink->sink);
+
+    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
+        for (group = gset->hash_tbl[i];    group;    group = group->next) {
+            if (group->mutepend) {
+                group->mutepend = FALSE;
+                mute_group_by_route(group, TRUE, u->nullsink);
+            }
+        }
+    }
+}
+
+void pa_policy_groupset_unregister_null_sink(struct userdata *u)
+{
+    struct pa_policy_groupset *gset;
+    struct pa_policy_group    *group;
+    struct pa_sink_input_list *sl;
+    struct pa_sink            *sink;
+    int                        i;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+
+    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
+        for (group = gset->hash_tbl[i];    group;    group = group->next) {
+            if (!group->mutebyrt || group->bus != NULL)
+                continue;
+
+            group->mutebyrt = FALSE;
+
+            if ((sink = group->sink) == NULL)
+                sink = defsink;
+
+            pa_log_debug("group '%s' is released from mute-by-route; "
+                         "move back its streams to sink '%s'", group->name,
+                         sink ? pa_sink_ext_get_name(sink) : "<null>");
+
+            for (sl = group->sinpls;   sl;   sl = sl->next) {
+                if (sl->parked) {
+                    sl->parked = FALSE;
+
+                    if (sink != NULL)
+                        move_sink_input(group, sl, sink);
+                }
+            }
+        }
+    }
+}
+
+void pa_policy_groupset_remove_buses(struct userdata *u)
+{
+    struct pa_policy_groupset  *gset;
+    struct pa_policy_group     *group;
+    int                         i;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+
+    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
+        for (group = gset->hash_tbl[i];    group;    group = group->next) {
+            if (group->bus != NULL) {
+                pa_log_debug("remove the bus of group '%s'", group->name);
+                release_bus(u, group);
+            }
+        }
+    }
+}
+
 
 
 struct pa_policy_group *pa_policy_group_new(struct userdata *u, char *name, 
@@ -302,6 +520,7 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, char *name,
     group->flags    = flags;
     group->name     = pa_xstrdup(name);
     group->limit    = PA_VOLUME_NORM;
+    group->resample = PA_RESAMPLER_INVALID;
     group->sinkname = sinkname ? pa_xstrdup(sinkname) : NULL;
     group->sink     = sinkname ? NULL : defsink;
     group->sinkidx  = sinkname ? PA_IDXSET_INVALID : defsinkidx;
@@ -311,6 +530,9 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, char *name,
 
     gset->hash_tbl[idx] = group;
 
+    if (flags & PA_POLICY_GROUP_FLAG_GROUP_BUS)
+        schedule_buses(gset);
+
     pa_log_info("created group (%s|%d|%s|0x%04x)", group->name,
                 (group->limit * 100) / PA_VOLUME_NORM,
                 group->sink?group->sink->name:"<null>",
@@ -422,12 +644,13 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
     static uint32_t   route_flags = PA_POLICY_GROUP_FLAG_SET_SINK |
                                     PA_POLICY_GROUP_FLAG_ROUTE_AUDIO;
 
-    struct pa_policy_groupset *gset;
-    struct pa_policy_group    *group;
-    struct pa_sink_input_list *sl;
-    struct pa_null_sink       *ns;
-    char                      *sinp_name;
-    char                      *sink_name;
+    struct pa_policy_groupset  *gset;
+    struct pa_policy_group     *group;
+    struct pa_sink_input_list  *sl;
+    struct pa_null_sink        *ns;
+    struct pa_policy_group_bus *bus;
+    char                       *sinp_name;
+    char                       *sink_name;
 
 
     pa_assert(u);
@@ -446,10 +669,29 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
         sl->next = group->sinpls;
         sl->index = si->index;
         sl->sink_input = si;
+        sl->pendidx = PA_IDXSET_INVALID;
 
         group->sinpls = sl;
 
-        if (group->sink != NULL) {
+        if ((bus = group->bus) != NULL) {
+            /* route and volume limit are applied to the bus itself */
+            if (si->sink != bus->sink) {
+                pa_log_debug("move sink input '%s' to the bus of group '%s'",
+                             pa_sink_input_ext_get_name(si), group->name);
+
+                pa_sink_input_move_to(si, bus->sink, TRUE);
+            }
+
+            if ((group->flags & PA_POLICY_GROUP_FLAG_CORK_STREAM) &&
+                group->corked)
+            {
+                pa_log_debug("sink input '%s' corked",
+                             pa_sink_input_ext_get_name(si));
+
+                pa_sink_input_cork(si, TRUE);
+            }
+        }
+        else if (group->sink != NULL) {
             sinp_name = pa_sink_input_ext_get_name(si);
             sink_name = pa_sink_ext_get_name(group->sink);
 
@@ -457,16 +699,23 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
             if (group->mutebyrt) {
                 ns = u->nullsink;
 
-                pa_log_debug("move sink input '%s' to sink '%s'",
-                             sinp_name, ns->name);
+                if (si->sink != ns->sink) {
+                    pa_log_debug("move sink input '%s' to sink '%s'",
+                                 sinp_name, ns->name);
 
-                pa_sink_input_move_to(si, ns->sink, TRUE);
+                    pa_sink_input_move_to(si, ns->sink, TRUE);
+                }
+
+                sl->parked = TRUE;
             }
             else if (group->flags & route_flags) {
-                pa_log_debug("move sink input '%s' to sink '%s'",
-                             sinp_name, sink_name);
+                /* normally the NEW hook has put it already there */
+                if (si->sink != group->sink) {
+                    pa_log_debug("move sink input '%s' to sink '%s'",
+                                 sinp_name, sink_name);
 
-                pa_sink_input_move_to(si, group->sink, TRUE);
+                    pa_sink_input_move_to(si, group->sink, TRUE);
+                }
             }
 
 
@@ -484,11 +733,42 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
                 pa_log_debug("set volume limit %d for sink input '%s'",
                              (group->limit * 100) / PA_VOLUME_NORM,sinp_name);
 
-                pa_sink_input_ext_set_volume_limit(si, group->limit);
+                pa_sink_input_ext_set_volume_limit(u, &si, 1, group->limit);
+            }
+
+            /* whatever the flags are, a muted group stays muted */
+            if (group->muted) {
+                pa_log_debug("sink input '%s' muted in place", sinp_name);
+
+                pa_sink_input_set_mute(si, TRUE, FALSE);
+            }
+        }
+
+        if (group->latency > 0) {
+            if (!latency_fits(pa_sink_input_get_requested_latency(si),
+                              group->latency))
+            {
+                pa_log_debug("sink input '%s' keeps the lower latency "
+                             "requested by its client",
+                             pa_sink_input_ext_get_name(si));
+            }
+            else {
+                pa_log_debug("request %llu usec latency for sink input '%s'",
+                             (unsigned long long)group->latency,
+                             pa_sink_input_ext_get_name(si));
+
+                pa_sink_input_set_requested_latency(si, group->latency);
             }
         }
 
         group->sinpcnt++;
+        group->stats.ninsert++;
+
+        update_active_time(group);
+
+        if (group->maxsinp > 0 && group->overflow == pa_policy_overflow_cork &&
+            group->sinpcnt - group->shedcnt > group->maxsinp)
+            shed_sink_input(u, group);
 
         if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
             group->sinpcnt == 1)
@@ -525,6 +805,7 @@ void pa_policy_group_remove_sink_input(struct userdata *u, uint32_t idx)
             if ((sl = prev->next) != NULL && idx == sl->index) {
 
                 group->sinpcnt--;
+                group->stats.nremove++;
 
                 if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
                     group->sinpcnt < 1)
@@ -539,6 +820,13 @@ void pa_policy_group_remove_sink_input(struct userdata *u, uint32_t idx)
 
                 prev->next = sl->next;
 
+                update_active_time(group);
+
+                if (sl->shed)
+                    group->shedcnt--;
+                else if (group->shedcnt > 0)
+                    unshed_sink_input(u, group);
+
                 pa_xfree(sl);
 
                 pa_log_debug("sink input (idx=%d) removed from group '%s'",
@@ -552,6 +840,69 @@ void pa_policy_group_remove_sink_input(struct userdata *u, uint32_t idx)
     pa_log("Can't remove sink input (idx=%d): not a member of any group", idx);
 }
 
+/*
+ * Called when a sink input starts to run. Shed streams are corked again,
+ * as the client must not get around the stream cap by uncorking them.
+ * Otherwise a move deferred while the stream was corked is done now and
+ * the sink the stream plays to is resumed if we have suspended it.
+ */
+void pa_policy_group_sink_input_running(struct userdata      *u,
+                                        struct pa_sink_input *si)
+{
+    struct pa_policy_group    *group;
+    struct pa_sink_input_list *sl;
+    char                      *name;
+
+    pa_assert(u);
+    pa_assert(u->groups);
+    pa_assert(si);
+
+    name = pa_sink_input_ext_get_policy_group(si);
+
+    if ((group = find_group_by_name(u->groups, name, NULL)) != NULL) {
+        for (sl = group->sinpls;   sl != NULL;   sl = sl->next) {
+            if (sl->sink_input == si) {
+                if (sl->shed) {
+                    pa_log("sink input '%s' of group '%s' is shed; "
+                           "corked again", pa_sink_input_ext_get_name(si),
+                           group->name);
+
+                    pa_sink_input_cork(si, TRUE);
+                    return;
+                }
+
+                if (flush_deferred_move(group, sl) < 0) {
+                    pa_log("failed to do the deferred move of sink input "
+                           "'%s'", pa_sink_input_ext_get_name(si));
+                }
+                break;
+            }
+        }
+    }
+
+    if (si->sink != NULL)
+        resume_sink(u, si->sink);
+}
+
+int pa_policy_group_sink_input_allowed(struct pa_policy_group *group)
+{
+    pa_assert(group);
+
+    if (group->maxsinp > 0 && group->overflow == pa_policy_overflow_reject &&
+        group->sinpcnt >= group->maxsinp)
+    {
+        group->nreject++;
+
+        pa_log("group '%s' has already %d sink inputs; new one rejected "
+               "(%u rejected so far)", group->name, group->sinpcnt,
+               group->nreject);
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 void pa_policy_group_insert_source_output(struct userdata         *u,
                                           char                    *name,
                                           struct pa_source_output *so)
@@ -600,7 +951,27 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
             }
         }
 
+        if (group->latency > 0) {
+            if (!latency_fits(pa_source_output_get_requested_latency(so),
+                              group->latency))
+            {
+                pa_log_debug("source output '%s' keeps the lower latency "
+                             "requested by its client",
+                             pa_source_output_ext_get_name(so));
+            }
+            else {
+                pa_log_debug("request %llu usec latency for source output "
+                             "'%s'", (unsigned long long)group->latency,
+                             pa_source_output_ext_get_name(so));
+
+                pa_source_output_set_requested_latency(so, group->latency);
+            }
+        }
+
         group->soutcnt++;
+        group->stats.ninsert++;
+
+        update_active_time(group);
 
         if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
             group->soutcnt == 1)
@@ -636,6 +1007,7 @@ void pa_policy_group_remove_source_output(struct userdata *u, uint32_t idx)
         {
             if ((sl = prev->next) != NULL && idx == sl->index) {
                 group->soutcnt--;
+                group->stats.nremove++;
 
                 if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
                     group->soutcnt < 1)
@@ -650,6 +1022,8 @@ void pa_policy_group_remove_source_output(struct userdata *u, uint32_t idx)
 
                 prev->next = sl->next;
 
+                update_active_time(group);
+
                 pa_xfree(sl);
 
                 pa_log_debug("source output (idx=%d) removed from group '%s'",
@@ -704,7 +1078,7 @@ int pa_policy_group_move_to(struct userdata *u, char *name,
                 if (!(grp->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO))
                     ret = 0;
                 else
-                    ret = move_group(grp, &target);
+                    ret = move_group(u, grp, &target);
             }
         }
         else {                  /* move all groups */
@@ -712,7 +1086,7 @@ int pa_policy_group_move_to(struct userdata *u, char *name,
 
             for (curs = NULL; (grp = pa_policy_group_scan(u->groups, &curs));){
                 if ((grp->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO)) {
-                    if (move_group(grp, &target) < 0)
+                    if (move_group(u, grp, &target) < 0)
                         ret = -1;
                 }
             }
@@ -771,16 +1145,25 @@ int pa_policy_group_volume_limit(struct userdata *u, char *name,
             ret = 0;
         else {
             if (!(group->flags & PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE))
-                ret = volset_group(group, percent);
+                ret = volset_group(u, group, percent);
+            else if ((group->flags & PA_POLICY_GROUP_FLAG_MUTE_IN_PLACE) &&
+                     group->bus == NULL)
+            {
+                mute = percent > 0 ? FALSE : TRUE;
+                ret  = mute_group_in_place(u, group, mute);
+
+                if (!mute)
+                    volset_group(u, group, percent);
+            }
             else {
                 if (ns->sink == NULL)
-                    ret = volset_group(group, percent);
+                    ret = volset_group(u, group, percent);
                 else {
                     mute = percent > 0 ? FALSE : TRUE;
                     ret  = mute_group_by_route(group, mute, ns); 
                     
                     if (!mute)
-                        volset_group(group, percent);
+                        volset_group(u, group, percent);
                 }
             }
         }
@@ -822,28 +1205,44 @@ struct pa_policy_group *pa_policy_group_scan(struct pa_policy_groupset *gset,
     }
 }
 
+pa_usec_t pa_policy_group_active_time(struct pa_policy_group *group)
+{
+    pa_usec_t active;
+
+    pa_assert(group);
 
-static int move_group(struct pa_policy_group *group, struct target *target)
+    active = group->stats.active;
+
+    if (group->stats.actstart)
+        active += pa_rtclock_usec() - group->stats.actstart;
+
+    return active;
+}
+
+
+static int move_group(struct userdata *u, struct pa_policy_group *group,
+                      struct target *target)
 {
     static pa_subscription_event_type_t sinkev = PA_SUBSCRIPTION_EVENT_SINK |
                                                  PA_SUBSCRIPTION_EVENT_CHANGE;
     struct pa_core               *core;
     struct pa_sink               *sink;
+    struct pa_sink               *oldsink;
     struct pa_source             *source;
-    struct pa_sink_input_list    *sil;
     struct pa_source_output_list *sol;
-    struct pa_sink_input         *sinp;
     struct pa_source_output      *sout;
     pa_proplist                  *pl;
     const char                   *old_mode;
     const char                   *old_hwid;
     int                           prop_changed;
     char                         *sinkname;
+    pa_usec_t                     start;
     int                           ret = 0;
 
     if (group == NULL || target->any == NULL)
         ret = -1;
     else {
+        start = pa_rtclock_usec();
 
         switch (target->class) {
             
@@ -877,24 +1276,21 @@ static int move_group(struct pa_policy_group *group, struct target *target)
                 }
             }
             else {
+                oldsink = group->sink;
+
                 pa_xfree(group->sinkname);
                 group->sinkname = pa_xstrdup(sinkname);
                 group->sink = sink;
                 group->sinkidx = sink->index;
 
-                if (!group->mutebyrt) {
-                    for (sil = group->sinpls;    sil;   sil = sil->next) {
-                        sinp = sil->sink_input;
-                
-                        pa_log_debug("move sink input '%s' to sink '%s'",
-                                     pa_sink_input_ext_get_name(sinp),
-                                     sinkname);
+                if (group->sinpls != NULL)
+                    resume_sink(u, sink);
 
-                        if (pa_sink_input_move_to(sinp, sink, TRUE) < 0) {
-                            ret = -1;
-                        }
-                    }
-                }
+                if (move_streams(group, sink) < 0)
+                    ret = -1;
+
+                if (oldsink != NULL)
+                    suspend_sink(u, oldsink);
             }
 
             /* in case the sink properties changed announce it */
@@ -924,9 +1320,12 @@ static int move_group(struct pa_policy_group *group, struct target *target)
                     pa_log_debug("move source output '%s' to source '%s'",
                                  pa_source_output_ext_get_name(sout),
                                  pa_source_ext_get_name(source));
+
+                    group->stats.nmove++;
                     
                     if (pa_source_output_move_to(sout, source, TRUE) < 0) {
                         ret = -1;
+                        group->stats.nmvfail++;
                     
                         pa_log("failed to move source output '%s' to source "
                                "'%s'", pa_source_output_ext_get_name(sout),
@@ -940,40 +1339,66 @@ static int move_group(struct pa_policy_group *group, struct target *target)
             ret = -1;
             break;
         } /* switch class */
+
+        account_call(&group->stats.move, start);
     }
 
     return ret;
 }
 
 
-static int volset_group(struct pa_policy_group *group, pa_volume_t percent)
+static int volset_group(struct userdata *u, struct pa_policy_group *group,
+                        pa_volume_t percent)
 {
     pa_volume_t limit;
     struct pa_sink_input_list *sl;
-    struct pa_sink_input *sinp;
+    struct pa_sink_input **sinps;
+    pa_usec_t start;
+    int nsinp;
     int ret = 0;
 
 
+    start = pa_rtclock_usec();
     limit = ((percent > 100 ? 100 : percent) * PA_VOLUME_NORM) / 100;
 
     if (limit == group->limit) {
         pa_log_debug("group '%s' volume limit is already %d",
                      group->name, percent);
     }
+    else if (group->bus != NULL) {
+        group->limit = limit;
+        group->stats.nvolset++;
+
+        pa_log_debug("set volume limit %d for the bus of group '%s'",
+                     percent, group->name);
+
+        set_bus_volume(group->bus, limit);
+    }
     else {
         group->limit = limit;
+        group->stats.nvolset++;
 
-        for (sl = group->sinpls;   sl != NULL;   sl = sl->next) {
-            sinp = sl->sink_input;
+        for (nsinp = 0, sl = group->sinpls;   sl != NULL;   sl = sl->next)
+            nsinp++;
 
-            if (pa_sink_input_ext_set_volume_limit(sinp, limit) < 0)
+        if (nsinp > 0) {
+            sinps = pa_xnew(struct pa_sink_input *, nsinp);
+
+            for (nsinp = 0, sl = group->sinpls;   sl != NULL;   sl = sl->next)
+                sinps[nsinp++] = sl->sink_input;
+
+            if (pa_sink_input_ext_set_volume_limit(u, sinps,nsinp,limit) < 0)
                 ret = -1;
             else
-                pa_log_debug("set volume limit %d for sink input '%s'",
-                             percent, pa_sink_input_ext_get_name(sinp));
+                pa_log_debug("set volume limit %d for %d sink input(s) of "
+                             "group '%s'", percent, nsinp, group->name);
+
+            pa_xfree(sinps);
         }
     }
 
+    account_call(&group->stats.volset, start);
+
     return ret;
 }
 
@@ -987,9 +1412,23 @@ static int mute_group_by_route(struct pa_policy_group *group, int mute,
     char *sink_name;
     int ret = 0;
 
+    /* a newer request overrides the one restored from the state file */
+    group->mutepend = FALSE;
+
     sink = mute ? ns->sink : group->sink;
 
-    if (sink == NULL) {
+    if (group->bus != NULL) {
+        /* no need to move anything; the bus is simply muted */
+        if (mute != group->mutebyrt) {
+            pa_log_debug("bus of group '%s' is %s due to mute-by-route",
+                         group->name, mute ? "muted" : "unmuted");
+
+            group->mutebyrt = mute;
+
+            pa_sink_set_mute(group->bus->sink, mute);
+        }
+    }
+    else if (sink == NULL) {
         pa_log("invalid (<null>) target sink for mute-by-route");
         ret = -1;
     }
@@ -1015,8 +1454,15 @@ static int mute_group_by_route(struct pa_policy_group *group, int mute,
                              "mute-by-route",
                              pa_sink_input_ext_get_name(sinp), sink_name);
 
-                if (pa_sink_input_move_to(sinp, sink, TRUE) < 0)
+                sl->pendidx = PA_IDXSET_INVALID;
+                sl->parked  = mute;
+
+                group->stats.nmove++;
+
+                if (pa_sink_input_move_to(sinp, sink, TRUE) < 0) {
+                    group->stats.nmvfail++;
                     ret = -1;
+                }
             }
         }
     }
@@ -1025,12 +1471,39 @@ static int mute_group_by_route(struct pa_policy_group *group, int mute,
 }
 
 
+static int mute_group_in_place(struct userdata *u,
+                               struct pa_policy_group *group, int mute)
+{
+    struct pa_sink_input_list *sl;
+
+    if (mute == group->muted) {
+        pa_log_debug("group '%s' is already %s in place", group->name,
+                     mute ? "muted" : "unmuted");
+    }
+    else {
+        /* the streams stay on their sink with their volume untouched */
+        group->muted = mute;
+
+        for (sl = group->sinpls;   sl != NULL;   sl = sl->next)
+            pa_sink_input_set_mute(sl->sink_input, mute, FALSE);
+
+        pa_log_debug("group '%s' is %s in place", group->name,
+                     mute ? "muted" : "unmuted");
+    }
+
+    return 0;
+}
+
+
 static int cork_group(struct pa_policy_group *group, int corked)
 {
     struct pa_sink_input_list *sl;
     struct pa_sink_input *sinp;
+    pa_usec_t start;
 
 
+    start = pa_rtclock_usec();
+
     if (corked == group->corked) {
         pa_log_debug("group '%s' is already %s", group->name,
                      corked ? "corked" : "uncorked");
@@ -1038,26 +1511,350 @@ static int cork_group(struct pa_policy_group *group, int corked)
     else {
         group->corked = corked;
 
+        if (corked)
+            group->stats.ncork++;
+        else
+            group->stats.nuncork++;
+
         for (sl = group->sinpls;    sl;   sl = sl->next) {
             sinp = sl->sink_input;
-            
+
+            if (!corked && flush_deferred_move(group, sl) < 0) {
+                pa_log("failed to do the deferred move of sink input '%s'",
+                       pa_sink_input_ext_get_name(sinp));
+            }
+
+            /* streams shed by maxsinp stay corked */
+            if (!corked && sl->shed)
+                continue;
+
             pa_sink_input_cork(sinp, corked);
-            
+
             pa_log_debug("sink input '%s' %s",
                          pa_sink_input_ext_get_name(sinp),
                          corked ? "corked" : "uncorked");
         }
     }
 
+    account_call(&group->stats.cork, start);
+
+    return 0;
+}
+
+
+static int move_sink_input(struct pa_policy_group    *group,
+                           struct pa_sink_input_list *sl,
+                           struct pa_sink            *sink)
+{
+    struct pa_sink_input *sinp = sl->sink_input;
+
+    sl->pendidx = PA_IDXSET_INVALID;
+
+    if (sinp->sink == sink)
+        return 0;
+
+    pa_log_debug("move sink input '%s' to sink '%s'",
+                 pa_sink_input_ext_get_name(sinp), pa_sink_ext_get_name(sink));
+
+    group->stats.nmove++;
+
+    if (pa_sink_input_move_to(sinp, sink, TRUE) < 0) {
+        group->stats.nmvfail++;
+        return -1;
+    }
+
     return 0;
 }
 
 
+static int flush_deferred_move(struct pa_policy_group    *group,
+                               struct pa_sink_input_list *sl)
+{
+    struct pa_sink_input *sinp = sl->sink_input;
+    struct pa_sink       *sink;
+
+    if (sl->pendidx == PA_IDXSET_INVALID)
+        return 0;
+
+    if ((sink = pa_idxset_get_by_index(sinp->core->sinks, sl->pendidx))==NULL){
+        pa_log_debug("target sink (idx=%d) of the deferred move of sink "
+                     "input '%s' is gone", sl->pendidx,
+                     pa_sink_input_ext_get_name(sinp));
+
+        sl->pendidx = PA_IDXSET_INVALID;
+
+        return 0;
+    }
+
+    return move_sink_input(group, sl, sink);
+}
+
+
+static int move_streams(struct pa_policy_group *group, struct pa_sink *sink)
+{
+    struct pa_sink_input_list *sil;
+    struct pa_sink_input      *sinp;
+    char                      *sinkname;
+    int                        ret = 0;
+
+    sinkname = pa_sink_ext_get_name(sink);
+
+    if (group->bus != NULL) {
+        if (group->bus->sinp->sink != sink) {
+            pa_log_debug("move the bus of group '%s' to sink '%s'",
+                         group->name, sinkname);
+
+            group->stats.nmove++;
+
+            if (pa_sink_input_move_to(group->bus->sinp, sink, TRUE) < 0) {
+                pa_log("failed to move the bus of group '%s' to "
+                       "sink '%s'", group->name, sinkname);
+                group->stats.nmvfail++;
+                ret = -1;
+            }
+        }
+    }
+    else if (!group->mutebyrt) {
+        for (sil = group->sinpls;    sil;   sil = sil->next) {
+            sinp = sil->sink_input;
+
+            /*
+             * corked streams of lazy groups are moved only
+             * when they get uncorked or started
+             */
+            if ((group->flags & PA_POLICY_GROUP_FLAG_LAZY_MOVE) &&
+                sinp->sink != sink                              &&
+                pa_sink_input_get_state(sinp) == PA_SINK_INPUT_CORKED)
+            {
+                pa_log_debug("defer the move of sink input '%s' to sink '%s'",
+                             pa_sink_input_ext_get_name(sinp), sinkname);
+
+                sil->pendidx = sink->index;
+            }
+            else if (move_sink_input(group, sil, sink) < 0) {
+                ret = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+
+static void shed_sink_input(struct userdata *u, struct pa_policy_group *group)
+{
+    struct pa_sink_input_list *sl;
+    struct pa_sink_input_list *oldest = NULL;
+    struct pa_sink_input      *sinp;
+
+    /* new streams are inserted to the head of the list */
+    for (sl = group->sinpls;   sl != NULL;   sl = sl->next) {
+        if (!sl->shed)
+            oldest = sl;
+    }
+
+    if (oldest != NULL) {
+        sinp = oldest->sink_input;
+
+        oldest->shed = TRUE;
+        group->shedcnt++;
+        group->nshed++;
+
+        pa_log("group '%s' has more than %d sink inputs; sink input '%s' "
+               "corked (%u shed so far)", group->name, group->maxsinp,
+               pa_sink_input_ext_get_name(sinp), group->nshed);
+
+        pa_sink_input_cork(sinp, TRUE);
+    }
+}
+
+
+static void unshed_sink_input(struct userdata        *u,
+                              struct pa_policy_group *group)
+{
+    struct pa_sink_input_list *sl;
+    struct pa_sink_input      *sinp;
+
+    /* the most recently shed one is the first in the list */
+    for (sl = group->sinpls;   sl != NULL;   sl = sl->next) {
+        if (sl->shed) {
+            sinp = sl->sink_input;
+
+            sl->shed = FALSE;
+            group->shedcnt--;
+
+            pa_log_debug("sink input '%s' of group '%s' is not shed any more",
+                         pa_sink_input_ext_get_name(sinp), group->name);
+
+            if (!group->corked)
+                pa_sink_input_cork(sinp, FALSE);
+
+            break;
+        }
+    }
+}
+
+
+static struct pa_policy_group_bus *create_bus(struct userdata        *u,
+                                              struct pa_policy_group *group)
+{
+    struct pa_policy_groupset  *gset;
+    struct pa_policy_group_bus *bus;
+    pa_module                  *m;
+    struct pa_sink             *sink;
+    struct pa_sink_input       *sinp;
+    struct pa_sink_input_list  *sl;
+    void                       *state;
+    char                       *args;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+    pa_assert(group);
+
+    if ((bus = group->bus) != NULL || group->sink == NULL)
+        return bus;
+
+    args = pa_sprintf_malloc("sink_name=%s%s master=%s",
+                             PA_POLICY_GROUP_BUS_PREFIX, group->name,
+                             pa_sink_ext_get_name(group->sink));
+
+    gset->busload = TRUE;
+    m = pa_module_load(u->core, PA_POLICY_GROUP_BUS_MODULE, args);
+    gset->busload = FALSE;
+
+    pa_xfree(args);
+
+    if (m == NULL) {
+        pa_log("failed to load the bus of group '%s'", group->name);
+        return NULL;
+    }
+
+    for (state = NULL; (sink = pa_idxset_iterate(u->core->sinks, &state, NULL));){
+        if (sink->module == m)
+            break;
+    }
+
+    for (state = NULL;
+         (sinp = pa_idxset_iterate(u->core->sink_inputs, &state, NULL));)
+    {
+        if (sinp->module == m)
+            break;
+    }
+
+    if (sink == NULL || sinp == NULL) {
+        pa_log("can't find the sink of the bus of group '%s'", group->name);
+        pa_module_unload_request(m, TRUE);
+        return NULL;
+    }
+
+    bus = pa_xnew0(struct pa_policy_group_bus, 1);
+    bus->modidx = m->index;
+    bus->sink   = sink;
+    bus->sinp   = sinp;
+
+    group->bus = bus;
+
+    pa_log_info("created bus '%s' for group '%s'",
+                pa_sink_ext_get_name(sink), group->name);
+
+    /* bring the bus to the current state of the group */
+    if (group->flags & PA_POLICY_GROUP_FLAG_LIMIT_VOLUME)
+        set_bus_volume(bus, group->limit);
+
+    if (group->mutebyrt)
+        pa_sink_set_mute(sink, TRUE);
+
+    /* the streams that are already there; the mute is on the bus now */
+    for (sl = group->sinpls;   sl;   sl = sl->next) {
+        sl->parked = FALSE;
+        move_sink_input(group, sl, sink);
+    }
+
+    return bus;
+}
+
+/*
+ * Move the streams of the group off the bus, or they would be killed
+ * together with it, and get rid of the bus.
+ */
+static void release_bus(struct userdata *u, struct pa_policy_group *group)
+{
+    struct pa_policy_group_bus *bus = group->bus;
+    struct pa_sink_input_list  *sl;
+    struct pa_sink             *sink;
+
+    if ((sink = group->sink) == NULL)
+        sink = defsink;
+
+    group->bus = NULL;
+
+    for (sl = group->sinpls;   sl;   sl = sl->next) {
+        if (sl->sink_input->sink != bus->sink)
+            continue;
+
+        if (group->mutebyrt && u->nullsink->sink != NULL) {
+            sl->parked = TRUE;
+            move_sink_input(group, sl, u->nullsink->sink);
+        }
+        else if (sink != NULL)
+            move_sink_input(group, sl, sink);
+    }
+
+    pa_module_unload_request_by_index(u->core, bus->modidx, TRUE);
+
+    pa_xfree(bus);
+}
+
+static void schedule_buses(struct pa_policy_groupset *gset)
+{
+    if (gset->busdefer != NULL)
+        gset->mainloop->defer_enable(gset->busdefer, TRUE);
+}
+
+/*
+ * Loading the bus module from a hook would create and move streams in the
+ * middle of another object's setup, so the buses are created from the main
+ * loop once the groups have got their sinks.
+ */
+static void create_buses(pa_mainloop_api *m, pa_defer_event *e,
+                         void *userdata)
+{
+    struct userdata           *u = userdata;
+    struct pa_policy_groupset *gset;
+    struct pa_policy_group    *group;
+    int                        i;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+
+    m->defer_enable(e, FALSE);
+
+    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
+        for (group = gset->hash_tbl[i];    group;    group = group->next) {
+            if ((group->flags & PA_POLICY_GROUP_FLAG_GROUP_BUS) &&
+                group->bus == NULL && group->sink != NULL)
+                create_bus(u, group);
+        }
+    }
+}
+
+
+static void set_bus_volume(struct pa_policy_group_bus *bus, pa_volume_t limit)
+{
+    pa_cvolume volume;
+
+    pa_cvolume_set(&volume, bus->sink->sample_spec.channels, limit);
+
+    pa_sink_set_volume(bus->sink, &volume);
+}
+
+
 static struct pa_policy_group *
 find_group_by_name(struct pa_policy_groupset *gset, char *name,uint32_t *ridx)
 {
     struct pa_policy_group *group = NULL;
-    uint32_t                idx   = hash_value(name);
+    uint32_t                idx   = pa_policy_hash_string(name) &
+                                    PA_POLICY_GROUP_HASH_MASK;
     
     pa_assert(gset);
     pa_assert(name);
@@ -1074,6 +1871,78 @@ find_group_by_name(struct pa_policy_groupset *gset, char *name,uint32_t *ridx)
 }
 
 
+static void suspend_sink(struct userdata *u, struct pa_sink *sink)
+{
+    struct pa_policy_groupset *gset;
+    struct pa_policy_group    *group;
+    char                      *name;
+    int                        i;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+    pa_assert(sink);
+
+    if (!gset->suspend || sink == u->nullsink->sink)
+        return;
+
+    name = pa_sink_ext_get_name(sink);
+
+    if (pa_sink_get_state(sink) == PA_SINK_SUSPENDED)
+        return;
+
+    for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
+        for (group = gset->hash_tbl[i];    group;    group = group->next) {
+            if (group->sink == sink)
+                return;
+        }
+    }
+
+    if (pa_sink_used_by(sink) > 0) {
+        pa_log_debug("sink '%s' is not suspended: still in use", name);
+        return;
+    }
+
+    if (pa_sink_suspend(sink, TRUE) < 0)
+        pa_log("failed to suspend sink '%s'", name);
+    else {
+        pa_log_debug("sink '%s' suspended as no group uses it", name);
+
+        pa_idxset_put(gset->suspidx, SUSPIDX_KEY(sink->index), NULL);
+    }
+}
+
+
+/*
+ * Only the sinks suspended by us are resumed; a suspend by the user or
+ * by other modules is left alone.
+ */
+static void resume_sink(struct userdata *u, struct pa_sink *sink)
+{
+    struct pa_policy_groupset *gset;
+    void                      *ours;
+    char                      *name;
+
+    pa_assert(u);
+    pa_assert_se((gset = u->groups));
+    pa_assert(sink);
+
+    if (!gset->suspend)
+        return;
+
+    ours = pa_idxset_remove_by_data(gset->suspidx,
+                                    SUSPIDX_KEY(sink->index), NULL);
+
+    if (ours && pa_sink_get_state(sink) == PA_SINK_SUSPENDED) {
+        name = pa_sink_ext_get_name(sink);
+
+        if (pa_sink_suspend(sink, FALSE) < 0)
+            pa_log("failed to resume sink '%s'", name);
+        else
+            pa_log_debug("sink '%s' resumed", name);
+    }
+}
+
+
 static struct pa_sink *find_sink_by_type(struct userdata *u, char *type)
 {
     void            *state = NULL;
@@ -1112,18 +1981,45 @@ static struct pa_source *find_source_by_type(struct userdata *u, char *type)
     return source;
 }
 
-static uint32_t hash_value(char *s)
+/*
+ * The group latency is requested when the stream is put, i.e. after the
+ * client has sized its buffer for the latency it asked for. Raising the
+ * latency above that would just starve the stream, so the group can only
+ * lower the latency of a stream.
+ */
+static int latency_fits(pa_usec_t requested, pa_usec_t latency)
 {
-    uint32_t hash = 0;
-    unsigned char c;
+    if (requested == 0 || requested == (pa_usec_t)-1)
+        return TRUE;            /* the client did not ask for anything */
 
-    if (s) {
-        while ((c = *s++) != '\0') {
-            hash = 38501 * (hash + c);
-        }
+    return latency < requested;
+}
+
+
+static void update_active_time(struct pa_policy_group *group)
+{
+    struct pa_policy_group_stats *stats = &group->stats;
+
+    if (group->sinpcnt > 0 || group->soutcnt > 0) {
+        if (!stats->actstart)
+            stats->actstart = pa_rtclock_usec();
     }
+    else if (stats->actstart) {
+        stats->active  += pa_rtclock_usec() - stats->actstart;
+        stats->actstart = 0;
+    }
+}
+
+
+static void account_call(struct pa_policy_group_timer *timer, pa_usec_t start)
+{
+    pa_usec_t elapsed = pa_rtclock_usec() - start;
+
+    timer->calls++;
+    timer->total += elapsed;
 
-    return hash & PA_POLICY_GROUP_HASH_MASK;
+    if (elapsed > timer->max)
+        timer->max = elapsed;
 }
 
 
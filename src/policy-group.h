@@ -3,6 +3,7 @@
 
 #include <pulse/volume.h>
 #include <pulsecore/sink.h>
+#include <pulsecore/resampler.h>
 
 #include "userdata.h"
 
@@ -20,16 +21,31 @@
 #define PA_POLICY_GROUP_FLAG_CORK_STREAM   PA_POLICY_GROUP_BIT(4)
 #define PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY  PA_POLICY_GROUP_BIT(5)
 #define PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE PA_POLICY_GROUP_BIT(6)
+#define PA_POLICY_GROUP_FLAG_LAZY_MOVE     PA_POLICY_GROUP_BIT(7)
+#define PA_POLICY_GROUP_FLAG_GROUP_BUS     PA_POLICY_GROUP_BIT(8)
+#define PA_POLICY_GROUP_FLAG_MUTE_IN_PLACE PA_POLICY_GROUP_BIT(9)
 
 #define PA_POLICY_GROUP_FLAGS_CLIENT      (PA_POLICY_GROUP_FLAG_LIMIT_VOLUME |\
                                            PA_POLICY_GROUP_FLAG_CORK_STREAM  )
 
 #define PA_POLICY_GROUP_FLAGS_NOPOLICY     PA_POLICY_GROUP_FLAG_NONE
 
+enum pa_policy_group_overflow {
+    pa_policy_overflow_unknown = 0,
+    pa_policy_overflow_reject,      /* reject new streams */
+    pa_policy_overflow_cork,        /* cork the oldest streams */
+};
+
+#define PA_POLICY_GROUP_BUS_MODULE        "module-remap-sink"
+#define PA_POLICY_GROUP_BUS_PREFIX        "policy.bus."
+
 struct pa_sink_input_list {
     struct pa_sink_input_list    *next;
     uint32_t                      index;
     struct pa_sink_input         *sink_input;
+    uint32_t                      pendidx;  /* sink index of deferred move */
+    int                           parked;   /* on the null sink by mutebyrt */
+    int                           shed;     /* corked due to maxsinp */
 };
 
 struct pa_source_output_list {
@@ -38,6 +54,33 @@ struct pa_source_output_list {
     struct pa_source_output      *source_output;
 };
 
+struct pa_policy_group_bus {
+    uint32_t                      modidx;   /* index of the bus module */
+    struct pa_sink               *sink;     /* virtual sink of the bus */
+    struct pa_sink_input         *sinp;     /* bus' stream on the real sink */
+};
+
+struct pa_policy_group_timer {
+    uint32_t                      calls;    /* number of calls */
+    pa_usec_t                     total;    /* cumulative wall time */
+    pa_usec_t                     max;      /* longest single call */
+};
+
+struct pa_policy_group_stats {
+    uint32_t                      ninsert;  /* # of inserted streams */
+    uint32_t                      nremove;  /* # of removed streams */
+    uint32_t                      nmove;    /* # of stream moves issued */
+    uint32_t                      nmvfail;  /* # of failed stream moves */
+    uint32_t                      ncork;    /* # of cork toggles */
+    uint32_t                      nuncork;  /* # of uncork toggles */
+    uint32_t                      nvolset;  /* # of volume limit changes */
+    pa_usec_t                     active;   /* cumulative active time */
+    pa_usec_t                     actstart; /* start of active period or 0 */
+    struct pa_policy_group_timer  move;     /* cost of move_group() */
+    struct pa_policy_group_timer  cork;     /* cost of cork_group() */
+    struct pa_policy_group_timer  volset;   /* cost of volset_group() */
+};
+
 struct pa_policy_group {
     struct pa_policy_group       *next;
     uint32_t                      flags;    /* or'ed PA_POLICY_GROUP_FLAG_x's*/
@@ -51,15 +94,31 @@ struct pa_policy_group {
     pa_volume_t                   limit;    /* volume limit for the group */
     int                           corked;
     int                           mutebyrt; /* muted by routing to null sink */
+    int                           mutepend; /* mutebyrt once null sink is up */
+    int                           muted;    /* muted in place (zero volume) */
     struct pa_sink_input_list    *sinpls;   /* sink input list */
     struct pa_source_output_list *soutls;   /* source output list */
     int                           sinpcnt;  /* sink input counter */
     int                           soutcnt;  /* source output counter */
+    struct pa_policy_group_bus   *bus;      /* mixing bus, if any */
+    pa_usec_t                     latency;  /* max. stream latency or zero */
+    pa_resample_method_t          resample; /* resampler of the streams */
+    int                           maxsinp;  /* max. sink inputs or zero */
+    enum pa_policy_group_overflow overflow; /* what to do above maxsinp */
+    int                           shedcnt;  /* sink inputs corked by maxsinp */
+    uint32_t                      nreject;  /* # of rejected sink inputs */
+    uint32_t                      nshed;    /* # of shed sink inputs */
+    struct pa_policy_group_stats  stats;    /* lifecycle statistics */
 };
 
 struct pa_policy_groupset {
     struct pa_policy_group    *dflt;     /*  default group */
     struct pa_policy_group    *hash_tbl[PA_POLICY_GROUP_HASH_DIM];
+    int                        busload;  /* a bus module is being loaded */
+    int                        suspend;  /* suspend sinks left by routing */
+    pa_idxset                 *suspidx;  /* sinks suspended by us */
+    pa_mainloop_api           *mainloop;
+    pa_defer_event            *busdefer; /* to create the missing buses */
 };
 
 enum pa_policy_route_class {
@@ -78,6 +137,13 @@ void pa_policy_groupset_unregister_sink(struct userdata *, uint32_t);
 void pa_policy_groupset_register_source(struct userdata *, struct pa_source *);
 void pa_policy_groupset_unregister_source(struct userdata *, uint32_t);
 void pa_policy_groupset_create_default_group(struct userdata *, const char *);
+void pa_policy_groupset_route_suspend(struct userdata *, const char *);
+void pa_policy_groupset_resume_sink(struct userdata *, struct pa_sink *);
+int  pa_policy_groupset_is_bus(struct userdata *, struct pa_module *);
+int  pa_policy_groupset_unregister_bus(struct userdata *, struct pa_sink *);
+void pa_policy_groupset_remove_buses(struct userdata *);
+void pa_policy_groupset_register_null_sink(struct userdata *);
+void pa_policy_groupset_unregister_null_sink(struct userdata *);
 
 struct pa_policy_group *pa_policy_group_new(struct userdata *, char*,
                                             char *, char *, uint32_t);
@@ -88,6 +154,9 @@ struct pa_policy_group *pa_policy_group_find(struct userdata *, char *);
 void pa_policy_group_insert_sink_input(struct userdata *, char *,
                                        struct pa_sink_input *);
 void pa_policy_group_remove_sink_input(struct userdata *, uint32_t);
+void pa_policy_group_sink_input_running(struct userdata *,
+                                        struct pa_sink_input *);
+int  pa_policy_group_sink_input_allowed(struct pa_policy_group *);
 
 
 void pa_policy_group_insert_source_output(struct userdata *, char *,
@@ -101,6 +170,7 @@ int  pa_policy_group_cork(struct userdata *u, char *, int);
 int  pa_policy_group_volume_limit(struct userdata *, char *, uint32_t);
 struct pa_policy_group *pa_policy_group_scan(struct pa_policy_groupset *,
                                              void **);
+pa_usec_t pa_policy_group_active_time(struct pa_policy_group *);
 
 
 #endif
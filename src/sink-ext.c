@@ -109,7 +109,11 @@ static pa_hook_result_t sink_put(void *hook_data, void *call_data,
     struct pa_sink  *sink = (struct pa_sink *)call_data;
     struct userdata *u    = (struct userdata *)slot_data;
 
-    handle_new_sink(u, sink);
+    /* the buses of the policy groups are not subject of the policy */
+    if (pa_policy_groupset_is_bus(u, sink->module))
+        pa_log_debug("new bus sink '%s'", pa_sink_ext_get_name(sink));
+    else
+        handle_new_sink(u, sink);
 
     return PA_HOOK_OK;
 }
@@ -121,7 +125,8 @@ static pa_hook_result_t sink_unlink(void *hook_data, void *call_data,
     struct pa_sink  *sink = (struct pa_sink *)call_data;
     struct userdata *u    = (struct userdata *)slot_data;
 
-    handle_removed_sink(u, sink);
+    if (!pa_policy_groupset_unregister_bus(u, sink))
+        handle_removed_sink(u, sink);
 
     return PA_HOOK_OK;
 }
@@ -150,6 +155,8 @@ static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
             pa_log_debug("new sink '%s' (idx=%d) will be used to "
                          "mute-by-route", name, idx);
             is_null_sink = TRUE;
+
+            pa_policy_groupset_register_null_sink(u);
         }
 
         pa_policy_context_register(u, pa_policy_object_sink, name, sink);
@@ -201,8 +208,7 @@ static void handle_removed_sink(struct userdata *u, struct pa_sink *sink)
             pa_log_debug("cease to use sink '%s' (idx=%d) to mute-by-route",
                          name, idx);
 
-            /* TODO: move back the streams of this sink to their
-               original place */
+            pa_policy_groupset_unregister_null_sink(u);
 
             ns->sink = NULL;
         }
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
@@ -10,6 +11,11 @@
 #include <pulse/volume.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/sink-input.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/asyncmsgq.h>
+#include <pulsecore/resampler.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/core-subscribe.h>
 
 #include "userdata.h"
 #include "policy-group.h"
@@ -18,10 +24,56 @@
 #include "classify.h"
 #include "context.h"
 
+/*
+ * message object to pass batched requests to the IO thread of a sink
+ */
+typedef struct pa_sinp_msgobj {
+    pa_msgobject          parent;
+} pa_sinp_msgobj;
+
+PA_DECLARE_CLASS(pa_sinp_msgobj);
+#define PA_SINP_MSGOBJ(o) (pa_sinp_msgobj_cast(o))
+static PA_DEFINE_CHECK_TYPE(pa_sinp_msgobj, pa_msgobject);
+
+enum {
+    PA_SINP_MSGOBJ_MESSAGE_SET_VOLUME,
+    PA_SINP_MSGOBJ_MESSAGE_MAX
+};
+
+struct sinp_volume {
+    struct pa_sink_input *sinp;
+    pa_cvolume            volume;
+};
+
+/* apply_limits() keeps the limit each sink input already has */
+#define LIMIT_KEEP  ((pa_volume_t)-1)
+
+struct sinp_limit {
+    pa_volume_t            limit;
+    pa_cvolume             orig;     /* soft volume without the limit */
+    pa_cvolume             clamped;  /* soft volume we have set */
+};
+
+struct sinp_batch {
+    int                    nsinp;
+    struct sinp_volume    *volumes;
+};
+
+static int sinp_msgobj_process_msg(pa_msgobject *, int, void *,
+                                   int64_t, pa_memchunk *);
+static int  apply_limits(struct pa_sinp_evsubscr *, struct pa_sink_input **,
+                         int, pa_volume_t);
+static void handle_volume_events(pa_core *, pa_subscription_event_type_t,
+                                 uint32_t, void *);
+static int  compare_sink(const void *, const void *);
+static void free_limit(void *, void *);
+
 /* hooks */
 static pa_hook_result_t sink_input_neew(void *, void *, void *);
 static pa_hook_result_t sink_input_put(void *, void *, void *);
 static pa_hook_result_t sink_input_unlink(void *, void *, void *);
+static pa_hook_result_t sink_input_state_changed(void *, void *, void *);
+static pa_hook_result_t sink_input_move_finish(void *, void *, void *);
 
 static void handle_new_sink_input(struct userdata *, struct pa_sink_input *);
 static void handle_removed_sink_input(struct userdata *,
@@ -35,6 +87,9 @@ struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *u)
     pa_hook_slot            *neew;
     pa_hook_slot            *put;
     pa_hook_slot            *unlink;
+    pa_hook_slot            *state;
+    pa_hook_slot            *move;
+    pa_sinp_msgobj          *msgobj;
     
     pa_assert(u);
     pa_assert_se((core = u->core));
@@ -47,13 +102,28 @@ struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *u)
                              PA_HOOK_LATE, sink_input_put, (void *)u);
     unlink = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_INPUT_UNLINK,
                              PA_HOOK_LATE, sink_input_unlink, (void *)u);
+    state  = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_INPUT_STATE_CHANGED,
+                             PA_HOOK_LATE, sink_input_state_changed,(void *)u);
+    move   = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH,
+                             PA_HOOK_LATE, sink_input_move_finish, (void *)u);
 
+    msgobj = pa_msgobject_new(pa_sinp_msgobj);
+    msgobj->parent.process_msg = sinp_msgobj_process_msg;
 
     subscr = pa_xnew0(struct pa_sinp_evsubscr, 1);
     
     subscr->neew   = neew;
     subscr->put    = put;
     subscr->unlink = unlink;
+    subscr->state  = state;
+    subscr->move   = move;
+    subscr->msgobj = PA_MSGOBJECT(msgobj);
+    subscr->limits = pa_hashmap_new(pa_idxset_trivial_hash_func,
+                                    pa_idxset_trivial_compare_func);
+    subscr->events = pa_subscription_new(core,
+                                         1 << PA_SUBSCRIPTION_EVENT_SINK_INPUT |
+                                         1 << PA_SUBSCRIPTION_EVENT_SINK,
+                                         handle_volume_events, (void *)u);
 
     return subscr;
 }
@@ -64,6 +134,12 @@ void  pa_sink_input_ext_subscription_free(struct pa_sinp_evsubscr *subscr)
         pa_hook_slot_free(subscr->neew);
         pa_hook_slot_free(subscr->put);
         pa_hook_slot_free(subscr->unlink);
+        pa_hook_slot_free(subscr->state);
+        pa_hook_slot_free(subscr->move);
+        pa_subscription_free(subscr->events);
+
+        pa_msgobject_unref(subscr->msgobj);
+        pa_hashmap_free(subscr->limits, free_limit, NULL);
         
         pa_xfree(subscr);
     }
@@ -79,8 +155,11 @@ void pa_sink_input_ext_discover(struct userdata *u)
     pa_assert(u->core);
     pa_assert_se((idxset = u->core->sink_inputs));
 
-    while ((sinp = pa_idxset_iterate(idxset, &state, NULL)) != NULL)
+    while ((sinp = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
+        /* do not trust any group left there by someone else */
+        pa_sink_input_ext_set_policy_group(sinp, NULL);
         handle_new_sink_input(u, sinp);
+    }
 }
 
 
@@ -128,43 +207,245 @@ char *pa_sink_input_ext_get_name(struct pa_sink_input *sinp)
 }
 
 
-int pa_sink_input_ext_set_volume_limit(struct pa_sink_input *sinp,
-                                       pa_volume_t limit)
+int pa_sink_input_ext_set_volume_limit(struct userdata       *u,
+                                       struct pa_sink_input **sinps,
+                                       int                    nsinp,
+                                       pa_volume_t            limit)
 {
-    pa_sink    *sink;
-#if 0
-    pa_cvolume *vol;
-    int         i;
-#endif
+    struct pa_sinp_evsubscr *subscr;
+    struct pa_sink_input   **pending;
+    struct pa_sink_input    *sinp;
+    int                      npending;
+    int                      i;
+    int                      ret;
 
-    pa_assert(sinp);
-    pa_assert_se((sink = sinp->sink));
+    pa_assert(u);
+    pa_assert_se((subscr = u->ssi));
+    pa_assert(sinps || nsinp <= 0);
 
-    if (limit == 0)
-        pa_sink_input_set_mute(sinp, TRUE, TRUE);
-    else {
-        pa_sink_input_set_mute(sinp, FALSE, TRUE);
+    if (nsinp <= 0)
+        return 0;
 
-#if 0
-        if (limit > PA_VOLUME_NORM)
-            limit = PA_VOLUME_NORM;
+    pending = pa_xnew(struct pa_sink_input *, nsinp);
 
-        vol = pa_xnewdup(struct pa_cvolume, &sinp->virtual_volume, 1);
-        
-        pa_assert(vol->channels <= PA_CHANNELS_MAX);
-        
-        for (i = 0;  i < vol->channels;  i++) {
-            if (vol->values[i] > limit)
-                vol->values[i] = limit;
+    /* zero limit is a mute, as it always was */
+    for (i = npending = 0;   i < nsinp;   i++) {
+        if ((sinp = sinps[i]) == NULL)
+            continue;
+
+        pa_sink_input_set_mute(sinp, limit == 0, TRUE);
+
+        if (limit > 0 && sinp->sink != NULL)
+            pending[npending++] = sinp;
+    }
+
+    ret = apply_limits(subscr, pending, npending, limit);
+
+    pa_xfree(pending);
+
+    return ret;
+}
+
+
+/*
+ * Sort the sink inputs by sink and hand the clamped soft volumes of each
+ * sink over to its IO thread in one message. The main thread copy of the
+ * soft volume is changed as well and the unlimited volume is kept aside
+ * to be restored later on. With LIMIT_KEEP every sink input gets the
+ * limit it already has; this is how the clamp is put back after the core
+ * has recalculated the soft volume.
+ */
+static int apply_limits(struct pa_sinp_evsubscr *subscr,
+                        struct pa_sink_input   **sinps,
+                        int                      nsinp,
+                        pa_volume_t              limit)
+{
+    struct pa_sink_input *sinp;
+    struct sinp_volume   *vol;
+    struct sinp_limit    *lim;
+    struct sinp_batch     batch;
+    pa_sink              *sink;
+    pa_volume_t           max;
+    int                   i, ch;
+    int                   ret = 0;
+
+    if (nsinp <= 0)
+        return 0;
+
+    batch.volumes = pa_xnew(struct sinp_volume, nsinp);
+
+    qsort(sinps, nsinp, sizeof(*sinps), compare_sink);
+
+    for (i = 0;   i < nsinp;   ) {
+        sink = sinps[i]->sink;
+
+        batch.nsinp = 0;
+
+        for (  ;   i < nsinp && sinps[i]->sink == sink;   i++) {
+            sinp = sinps[i];
+            vol  = batch.volumes + batch.nsinp++;
+
+            lim = pa_hashmap_get(subscr->limits, sinp);
+
+            /* the core might have recalculated the volume meanwhile */
+            if (lim && !pa_cvolume_equal(&sinp->soft_volume, &lim->clamped))
+                lim->orig = sinp->soft_volume;
+
+            vol->sinp   = sinp;
+            vol->volume = lim ? lim->orig : sinp->soft_volume;
+
+            pa_assert(vol->volume.channels <= PA_CHANNELS_MAX);
+
+            if (limit != LIMIT_KEEP)
+                max = limit;
+            else
+                max = lim ? lim->limit : PA_VOLUME_NORM;
+
+            /* full limit restores the original soft volume */
+            if (max >= PA_VOLUME_NORM) {
+                if (lim != NULL) {
+                    pa_hashmap_remove(subscr->limits, sinp);
+                    pa_xfree(lim);
+                }
+            }
+            else {
+                if (lim == NULL) {
+                    lim = pa_xnew(struct sinp_limit, 1);
+                    lim->orig = vol->volume;
+                    pa_hashmap_put(subscr->limits, sinp, lim);
+                }
+
+                for (ch = 0;  ch < vol->volume.channels;  ch++) {
+                    if (vol->volume.values[ch] > max)
+                        vol->volume.values[ch] = max;
+                }
+
+                lim->limit   = max;
+                lim->clamped = vol->volume;
+            }
+
+            sinp->soft_volume = vol->volume;
+        }
+
+        pa_log_debug("set volume limit for %d sink input(s) on sink '%s'",
+                     batch.nsinp, pa_sink_ext_get_name(sink));
+
+        if (pa_asyncmsgq_send(sink->asyncmsgq, subscr->msgobj,
+                              PA_SINP_MSGOBJ_MESSAGE_SET_VOLUME,
+                              &batch, 0, NULL) < 0)
+        {
+            pa_log("failed to set volume limit on sink '%s'",
+                   pa_sink_ext_get_name(sink));
+            ret = -1;
+        }
+    }
+
+    pa_xfree(batch.volumes);
+
+    return ret;
+}
+
+
+/*
+ * The core recalculates the soft volume of a sink input when the client
+ * changes its volume or, with flat volumes, when the sink volume changes.
+ * That overwrites our clamp, so it is put back as soon as we hear of it.
+ */
+static void handle_volume_events(pa_core *c, pa_subscription_event_type_t t,
+                                 uint32_t idx, void *userdata)
+{
+    struct userdata         *u = userdata;
+    struct pa_sinp_evsubscr *subscr;
+    struct pa_sink_input   **sinps;
+    struct pa_sink_input    *sinp;
+    struct sinp_limit       *lim;
+    const void              *key;
+    void                    *state = NULL;
+    uint32_t                 facility;
+    int                      nsinp;
+
+    pa_assert(u);
+    pa_assert_se((subscr = u->ssi));
+
+    if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_CHANGE)
+        return;
+
+    if (pa_hashmap_isempty(subscr->limits))
+        return;
+
+    facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    sinps    = pa_xnew(struct pa_sink_input *,
+                       pa_hashmap_size(subscr->limits));
+    nsinp    = 0;
+
+    while ((lim = pa_hashmap_iterate(subscr->limits, &state, &key)) != NULL) {
+        sinp = (struct pa_sink_input *)key;
+
+        if (sinp->sink == NULL ||
+            pa_cvolume_equal(&sinp->soft_volume, &lim->clamped))
+            continue;
+
+        if ((facility == PA_SUBSCRIPTION_EVENT_SINK_INPUT &&
+             sinp->index == idx) ||
+            (facility == PA_SUBSCRIPTION_EVENT_SINK &&
+             sinp->sink->index == idx))
+        {
+            sinps[nsinp++] = sinp;
         }
-        
-        pa_asyncmsgq_post(sink->asyncmsgq, PA_MSGOBJECT(sinp),
-                          PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME,
-                          vol, 0,NULL, pa_xfree);
-#endif
     }
 
-    return 0;
+    if (nsinp > 0) {
+        pa_log_debug("volume of %d limited sink input(s) changed; "
+                     "limit applied again", nsinp);
+
+        apply_limits(subscr, sinps, nsinp, LIMIT_KEEP);
+    }
+
+    pa_xfree(sinps);
+}
+
+
+/* called from the IO thread of the sink */
+static int sinp_msgobj_process_msg(pa_msgobject *o, int code, void *userdata,
+                                   int64_t offset, pa_memchunk *chunk)
+{
+    struct sinp_batch    *batch = (struct sinp_batch *)userdata;
+    struct pa_sink_input *sinp;
+    int                   i;
+
+    pa_assert(PA_SINP_MSGOBJ(o));
+
+    switch (code) {
+
+    case PA_SINP_MSGOBJ_MESSAGE_SET_VOLUME:
+        for (i = 0;   i < batch->nsinp;   i++) {
+            sinp = batch->volumes[i].sinp;
+
+            sinp->thread_info.soft_volume = batch->volumes[i].volume;
+            pa_sink_input_request_rewind(sinp, 0, TRUE, FALSE, FALSE);
+        }
+        return 0;
+
+    default:
+        break;
+    }
+
+    return -1;
+}
+
+
+static int compare_sink(const void *a, const void *b)
+{
+    const pa_sink *sa = (*(struct pa_sink_input * const *)a)->sink;
+    const pa_sink *sb = (*(struct pa_sink_input * const *)b)->sink;
+
+    return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+
+static void free_limit(void *limit, void *userdata)
+{
+    pa_xfree(limit);
 }
 
 
@@ -186,10 +467,39 @@ static pa_hook_result_t sink_input_neew(void *hook_data, void *call_data,
     pa_assert(u);
     pa_assert(data);
 
-    if ((group_name = pa_classify_sink_input_by_data(u, data)) != NULL &&
-        (group      = pa_policy_group_find(u, group_name)    ) != NULL    ) {
+    if (pa_policy_groupset_is_bus(u, data->module))
+        return PA_HOOK_OK;
+
+    /*
+     * the classification is passed over to the PUT hook in the proplist
+     * so the stream is neither classified nor routed again there
+     */
+    if ((group_name = pa_classify_sink_input_by_data(u, data)) == NULL)
+        pa_proplist_unset(data->proplist, PA_PROP_POLICY_GROUP);
+    else
+        pa_proplist_sets(data->proplist, PA_PROP_POLICY_GROUP, group_name);
+
+    if (group_name != NULL &&
+        (group = pa_policy_group_find(u, group_name)) != NULL) {
+
+        if (!pa_policy_group_sink_input_allowed(group))
+            return PA_HOOK_CANCEL;
+
+        if (group->resample != PA_RESAMPLER_INVALID) {
+            pa_log_debug("use resampler '%s' for the sink input of group "
+                         "'%s'", pa_resample_method_to_string(group->resample),
+                         group->name);
+
+            data->resample_method = group->resample;
+        }
+
+        if (group->bus != NULL) {
+            pa_log_debug("force sink input to the bus of group '%s'",
+                         group->name);
 
-        if (group->sink != NULL) {
+            data->sink = group->bus->sink;
+        }
+        else if (group->sink != NULL) {
             sinp_name = pa_proplist_gets(data->proplist, PA_PROP_MEDIA_NAME);
 
             if (!sinp_name)
@@ -197,7 +507,7 @@ static pa_hook_result_t sink_input_neew(void *hook_data, void *call_data,
 
             pa_log_debug("**** mutebyrt %d ****", group->mutebyrt);
 
-            if (group->mutebyrt) {
+            if (group->mutebyrt && u->nullsink->sink != NULL) {
                 sink_name = u->nullsink->name;
 
                 pa_log_debug("force sink input '%s' to sink '%s' due to "
@@ -228,7 +538,8 @@ static pa_hook_result_t sink_input_put(void *hook_data, void *call_data,
     struct pa_sink_input *sinp = (struct pa_sink_input *)call_data;
     struct userdata      *u    = (struct userdata *)slot_data;
 
-    handle_new_sink_input(u, sinp);
+    if (!pa_policy_groupset_is_bus(u, sinp->module))
+        handle_new_sink_input(u, sinp);
 
     return PA_HOOK_OK;
 }
@@ -240,7 +551,42 @@ static pa_hook_result_t sink_input_unlink(void *hook_data, void *call_data,
     struct pa_sink_input *sinp = (struct pa_sink_input *)call_data;
     struct userdata      *u    = (struct userdata *)slot_data;
 
-    handle_removed_sink_input(u, sinp);
+    pa_assert(u);
+    pa_assert(u->ssi);
+
+    pa_xfree(pa_hashmap_remove(u->ssi->limits, sinp));
+
+    if (!pa_policy_groupset_is_bus(u, sinp->module))
+        handle_removed_sink_input(u, sinp);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_state_changed(void *hook_data,
+                                                 void *call_data,
+                                                 void *slot_data)
+{
+    struct pa_sink_input *sinp = (struct pa_sink_input *)call_data;
+    struct userdata      *u    = (struct userdata *)slot_data;
+
+    /* shed streams are kept corked; others might have a pending move */
+    if (sinp && u && pa_sink_input_get_state(sinp) == PA_SINK_INPUT_RUNNING)
+        pa_policy_group_sink_input_running(u, sinp);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_move_finish(void *hook_data,
+                                               void *call_data,
+                                               void *slot_data)
+{
+    struct pa_sink_input *sinp = (struct pa_sink_input *)call_data;
+    struct userdata      *u    = (struct userdata *)slot_data;
+
+    /* whoever moved the stream, it must not end up on a sink we suspended */
+    if (sinp && u && sinp->sink &&
+        pa_sink_input_get_state(sinp) != PA_SINK_INPUT_CORKED)
+        pa_policy_groupset_resume_sink(u, sinp->sink);
 
     return PA_HOOK_OK;
 }
@@ -253,13 +599,20 @@ static void handle_new_sink_input(struct userdata      *u,
 
     if (sinp && u) {
         snam = pa_sink_input_ext_get_name(sinp);
-        gnam = pa_classify_sink_input(u, sinp);
+
+        /* streams that went through our NEW hook are already classified */
+        if (!(gnam = (char *)pa_proplist_gets(sinp->proplist,
+                                              PA_PROP_POLICY_GROUP)))
+            gnam = pa_classify_sink_input(u, sinp);
+
+        /* the sink might have been suspended by us when routing */
+        pa_policy_groupset_resume_sink(u, sinp->sink);
 
         pa_policy_context_register(u, pa_policy_object_sink_input, snam, sinp);
         pa_policy_group_insert_sink_input(u, gnam, sinp);
 
-        pa_log_debug("new sink_input %s (idx=%d) (group=%s)",
-                     snam, sinp->index, gnam);
+        pa_log_debug("new sink_input %s (idx=%d) (group=%s)", snam,
+                     sinp->index, pa_sink_input_ext_get_policy_group(sinp));
     }
 }
 
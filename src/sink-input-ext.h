@@ -8,6 +8,7 @@
 #include <pulsecore/sink-input.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/core-subscribe.h>
+#include <pulsecore/msgobject.h>
 
 
 #include "userdata.h"
@@ -16,6 +17,11 @@ struct pa_sinp_evsubscr {
     pa_hook_slot    *neew;
     pa_hook_slot    *put;
     pa_hook_slot    *unlink;
+    pa_hook_slot    *state;
+    pa_hook_slot    *move;
+    pa_msgobject    *msgobj;  /* to reach the IO threads of the sinks */
+    pa_hashmap      *limits;  /* unlimited volumes of the limited inputs */
+    pa_subscription *events;  /* to keep the limits over volume changes */
 };
 
 struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *);
@@ -24,7 +30,9 @@ void  pa_sink_input_ext_discover(struct userdata *);
 int   pa_sink_input_ext_set_policy_group(struct pa_sink_input *, char *);
 char *pa_sink_input_ext_get_policy_group(struct pa_sink_input *);
 char *pa_sink_input_ext_get_name(struct pa_sink_input *);
-int   pa_sink_input_ext_set_volume_limit(struct pa_sink_input *, pa_volume_t);
+int   pa_sink_input_ext_set_volume_limit(struct userdata *,
+                                         struct pa_sink_input **, int,
+                                         pa_volume_t);
 
 #endif
 
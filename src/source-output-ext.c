@@ -9,6 +9,7 @@
 #include <pulse/proplist.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/sink-input.h>
+#include <pulsecore/resampler.h>
 
 #include "policy-group.h"
 #include "source-ext.h"
@@ -145,6 +146,14 @@ static pa_hook_result_t source_output_neew(void *hook_data, void *call_data,
     if ((group_name = pa_classify_source_output_by_data(u, data)) != NULL &&
         (group      = pa_policy_group_find(u, group_name)       ) != NULL   ){
 
+        if (group->resample != PA_RESAMPLER_INVALID) {
+            pa_log_debug("use resampler '%s' for the source output of group "
+                         "'%s'", pa_resample_method_to_string(group->resample),
+                         group->name);
+
+            data->resample_method = group->resample;
+        }
+
         if (group->source != NULL && (group->flags & route_flags)) {
             sout_name = pa_proplist_gets(data->proplist, PA_PROP_MEDIA_NAME);
             source_name = pa_source_ext_get_name(group->source);
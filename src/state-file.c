@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <pulsecore/pulsecore-config.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+
+#include "state-file.h"
+#include "policy-group.h"
+#include "sink-ext.h"
+#include "classify.h"
+#include "context.h"
+
+/*
+ * The state is kept in a line oriented text file with tab separated fields:
+ *
+ *   pid     <pid>  <group>  <stream name or empty>
+ *   group   <name> <corked> <mutebyrt> <muted> <limit> <sink> <source>
+ *   context <variable> <value>
+ *
+ * Unknown records are ignored so that the format can be extended.
+ */
+
+#define STATE_VERSION  "1"
+#define STATE_BUFSIZE  1024
+#define STATE_FIELDS   8
+
+struct pa_policy_state_var {
+    struct pa_policy_state_var *next;
+    char                       *name;
+    char                       *value;
+};
+
+struct pa_policy_state {
+    struct pa_policy_state_var *vars;     /* context in definition order */
+    struct pa_policy_state_var *last;
+};
+
+static void save_pids(FILE *, struct pa_classify *);
+static void save_groups(FILE *, struct pa_policy_groupset *);
+static void save_context(FILE *, struct pa_policy_context *);
+static int  valid_field(const char *);
+
+static void restore_pid(struct userdata *, char **, int);
+static void restore_group(struct userdata *, char **, int);
+static void restore_context(struct pa_policy_state *, char **, int);
+static int  split_fields(char *, char **, int);
+static void skip_line(FILE *);
+
+static void state_free(struct pa_policy_state *);
+
+
+int pa_policy_state_save(struct userdata *u, const char *path)
+{
+    char  tmppath[PATH_MAX];
+    FILE *f;
+    int   success;
+
+    pa_assert(u);
+
+    if (path == NULL)
+        return TRUE;
+
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+    if ((f = fopen(tmppath, "w")) == NULL) {
+        pa_log("Can't open state file '%s': %s", tmppath, strerror(errno));
+        return FALSE;
+    }
+
+    fprintf(f, "version\t%s\n", STATE_VERSION);
+
+    save_pids(f, u->classify);
+    save_groups(f, u->groups);
+    save_context(f, u->context);
+
+    success = !ferror(f);
+
+    if (fclose(f) != 0)
+        success = FALSE;
+
+    if (success && rename(tmppath, path) < 0)
+        success = FALSE;
+
+    if (!success) {
+        pa_log("Can't save state to '%s': %s", path, strerror(errno));
+        unlink(tmppath);
+    }
+    else
+        pa_log_info("policy state saved to '%s'", path);
+
+    return success;
+}
+
+/*
+ * Restore the state saved by a previous instance. PID registrations and
+ * group states are applied right away so that the streams found by the
+ * discovery are classified and treated accordingly. The context values are
+ * returned to be replayed by pa_policy_state_replay() once the objects the
+ * context actions refer to are known.
+ */
+struct pa_policy_state *pa_policy_state_restore(struct userdata *u,
+                                                const char *path)
+{
+    struct pa_policy_state *state;
+    FILE                   *f;
+    char                    buf[STATE_BUFSIZE];
+    char                   *fields[STATE_FIELDS];
+    char                   *nl;
+    int                     nfield;
+    int                     lineno;
+
+    pa_assert(u);
+
+    if (path == NULL)
+        return NULL;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        if (errno != ENOENT)
+            pa_log("Can't open state file '%s': %s", path, strerror(errno));
+        return NULL;
+    }
+
+    state = pa_xnew0(struct pa_policy_state, 1);
+
+    for (lineno = 1;  fgets(buf, sizeof(buf), f) != NULL;  lineno++) {
+        if ((nl = strchr(buf, '\n')) != NULL)
+            *nl = '\0';
+        else if (!feof(f)) {
+            /* do not parse the rest of an over-long line as a new one */
+            pa_log("line %d in state file '%s' is too long; skipped",
+                   lineno, path);
+
+            skip_line(f);
+
+            if (lineno == 1)
+                break;
+
+            continue;
+        }
+
+        if ((nfield = split_fields(buf, fields, STATE_FIELDS)) < 1)
+            continue;
+
+        if (lineno == 1) {
+            if (strcmp(fields[0], "version") || nfield < 2 ||
+                strcmp(fields[1], STATE_VERSION))
+            {
+                pa_log("ignoring state file '%s' of unknown version", path);
+                break;
+            }
+        }
+        else if (!strcmp(fields[0], "pid"))
+            restore_pid(u, fields, nfield);
+        else if (!strcmp(fields[0], "group"))
+            restore_group(u, fields, nfield);
+        else if (!strcmp(fields[0], "context"))
+            restore_context(state, fields, nfield);
+    }
+
+    fclose(f);
+
+    /*
+     * the file is consumed; if we go down without saving it again
+     * the next instance should not pick up a stale state
+     */
+    unlink(path);
+
+    pa_log_info("policy state restored from '%s'", path);
+
+    return state;
+}
+
+void pa_policy_state_replay(struct userdata *u, struct pa_policy_state *state)
+{
+    struct pa_policy_state_var *var;
+
+    pa_assert(u);
+
+    if (state != NULL) {
+        for (var = state->vars;  var != NULL;  var = var->next) {
+            pa_log_debug("replay context (%s|%s)", var->name, var->value);
+            pa_policy_context_variable_changed(u, var->name, var->value);
+        }
+
+        state_free(state);
+    }
+}
+
+
+static void save_pids(FILE *f, struct pa_classify *classify)
+{
+    struct pa_classify_pid_hash *st;
+    int                          i;
+
+    for (i = 0;  i < PA_POLICY_PID_HASH_MAX;  i++) {
+        for (st = classify->streams.pid_hash[i];  st != NULL;  st = st->next) {
+            if (valid_field(st->group) && valid_field(st->stnam)) {
+                fprintf(f, "pid\t%d\t%s\t%s\n", (int)st->pid, st->group,
+                        st->stnam ? st->stnam : "");
+            }
+        }
+    }
+}
+
+static void save_groups(FILE *f, struct pa_policy_groupset *gset)
+{
+    struct pa_policy_group *group;
+    void                   *cursor = NULL;
+
+    while ((group = pa_policy_group_scan(gset, &cursor)) != NULL) {
+        if (valid_field(group->name)     &&
+            valid_field(group->sinkname) &&
+            valid_field(group->srcname)     )
+        {
+            fprintf(f, "group\t%s\t%d\t%d\t%d\t%u\t%s\t%s\n", group->name,
+                    group->corked, group->mutebyrt || group->mutepend,
+                    group->muted,
+                    (unsigned int)group->limit,
+                    group->sinkname ? group->sinkname : "",
+                    group->srcname  ? group->srcname  : "");
+        }
+    }
+}
+
+static void save_context(FILE *f, struct pa_policy_context *ctx)
+{
+    struct pa_policy_context_variable *var;
+
+    for (var = ctx->variables;  var != NULL;  var = var->next) {
+        if (var->value[0] && valid_field(var->name) && valid_field(var->value))
+            fprintf(f, "context\t%s\t%s\n", var->name, var->value);
+    }
+}
+
+static int valid_field(const char *field)
+{
+    if (field != NULL && strpbrk(field, "\t\n") != NULL) {
+        pa_log("'%s' can't be saved in the state file", field);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+static void restore_pid(struct userdata *u, char **fields, int nfield)
+{
+    pid_t  pid;
+    char  *stnam;
+
+    if (nfield < 4 || (pid = (pid_t)strtol(fields[1], NULL, 10)) <= 0)
+        return;
+
+    stnam = fields[3][0] ? fields[3] : NULL;
+
+    pa_log_debug("restore pid (%d|%s|%s)", (int)pid, fields[2],
+                 stnam ? stnam : "<null>");
+
+    pa_classify_register_pid(u, pid, stnam, fields[2]);
+}
+
+static void restore_group(struct userdata *u, char **fields, int nfield)
+{
+    struct pa_policy_group *group;
+
+    if (nfield < 8)
+        return;
+
+    if ((group = pa_policy_group_find(u, fields[1])) == NULL) {
+        pa_log_debug("state of unknown group '%s' is ignored", fields[1]);
+        return;
+    }
+
+    group->corked   = strtol(fields[2], NULL, 10) ? TRUE : FALSE;
+    group->muted    = strtol(fields[4], NULL, 10) ? TRUE : FALSE;
+    group->limit    = (pa_volume_t)strtoul(fields[5], NULL, 10);
+
+    if (group->limit > PA_VOLUME_NORM)
+        group->limit = PA_VOLUME_NORM;
+
+    /* mute-by-route needs the null sink; it might not be there yet */
+    if (strtol(fields[3], NULL, 10)) {
+        if (u->nullsink->sink != NULL)
+            group->mutebyrt = TRUE;
+        else
+            group->mutepend = TRUE;
+    }
+
+    /*
+     * the sinks and sources are not discovered yet; naming them makes
+     * the registration bind them to the group as they show up
+     */
+    if (fields[6][0]) {
+        pa_xfree(group->sinkname);
+        group->sinkname = pa_xstrdup(fields[6]);
+    }
+
+    if (fields[7][0]) {
+        pa_xfree(group->srcname);
+        group->srcname = pa_xstrdup(fields[7]);
+    }
+
+    pa_log_debug("restore group (%s|%s|%s|%d|%s|%s)", group->name,
+                 group->corked ? "corked" : "uncorked",
+                 group->mutebyrt ? "mutebyrt" :
+                 (group->mutepend ? "mutebyrt pending" : "-"),
+                 (group->limit * 100) / PA_VOLUME_NORM,
+                 group->sinkname ? group->sinkname : "<default>",
+                 group->srcname ? group->srcname : "<default>");
+}
+
+static void restore_context(struct pa_policy_state *state, char **fields,
+                            int nfield)
+{
+    struct pa_policy_state_var *var;
+
+    if (nfield < 3)
+        return;
+
+    var = pa_xnew0(struct pa_policy_state_var, 1);
+    var->name  = pa_xstrdup(fields[1]);
+    var->value = pa_xstrdup(fields[2]);
+
+    if (state->last == NULL)
+        state->vars = var;
+    else
+        state->last->next = var;
+
+    state->last = var;
+}
+
+static int split_fields(char *line, char **fields, int max)
+{
+    char *tab;
+    int   n;
+
+    if (!line[0])
+        return 0;
+
+    for (n = 0;  n < max;  n++) {
+        fields[n] = line;
+
+        if ((tab = strchr(line, '\t')) == NULL)
+            return n + 1;
+
+        *tab = '\0';
+        line = tab + 1;
+    }
+
+    return n;
+}
+
+static void skip_line(FILE *f)
+{
+    int c;
+
+    while ((c = getc(f)) != EOF && c != '\n')
+        ;
+}
+
+
+static void state_free(struct pa_policy_state *state)
+{
+    struct pa_policy_state_var *var;
+
+    while ((var = state->vars) != NULL) {
+        state->vars = var->next;
+
+        pa_xfree(var->name);
+        pa_xfree(var->value);
+        pa_xfree(var);
+    }
+
+    pa_xfree(state);
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,21 @@
+#ifndef foostatefilefoo
+#define foostatefilefoo
+
+#include "userdata.h"
+
+struct pa_policy_state;
+
+int  pa_policy_state_save(struct userdata *, const char *);
+struct pa_policy_state *pa_policy_state_restore(struct userdata *,
+                                                const char *);
+void pa_policy_state_replay(struct userdata *, struct pa_policy_state *);
+
+#endif
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
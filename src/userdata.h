@@ -42,6 +42,7 @@ struct userdata {
     struct pa_classify        *classify; /* rules for classification */
     struct pa_policy_context  *context;  /* for processing context variables */
     struct pa_policy_dbusif   *dbusif;
+    char                      *statefile;/* to persist state across reloads */
 };
 
 
@@ -49,6 +50,7 @@ struct userdata {
  * Some day this should go to a better place
  */
 const char *pa_policy_file_path(const char *file, char *buf, size_t len);
+uint32_t    pa_policy_hash_string(const char *s);
 
 
 #endif